@@ -0,0 +1,204 @@
+﻿//***************************************************************************************/
+// 
+// File name: AlignmentParams.h
+//
+// Synopsis: Implementation of the parameters that trade the speed of the alignment and
+//           merge against the accuracy of the transformation matrices. The parameters
+//           can be saved to and restored from a configuration file.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <fstream>
+#include <sstream>
+#include <string>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+// Default values of the parameters.
+static const MIL_INT    MERGE_DECIMATION_STEP      = 4;
+static const MIL_INT    FILL_GAPS_THRESHOLD_PIXEL  = 2;
+static const MIL_INT    CIRCLE_SEARCH_DETAIL_LEVEL = M_VERY_HIGH;
+static const MIL_DOUBLE CIRCLE_SEARCH_SMOOTHNESS   = 90.0;
+static const MIL_DOUBLE CIRCLE_SEARCH_ACCEPTANCE   = 75.0;
+static const MIL_DOUBLE SEGMENT_SEARCH_SMOOTHNESS  = 90.0;
+static const MIL_DOUBLE SEGMENT_SEARCH_ACCEPTANCE  = 75.0;
+static const MIL_DOUBLE PLANE_DATA_CROP_BOX_SCALE  = 2.0;
+
+// Valid ranges of the parameters in the configuration file.
+static const MIL_INT    MAX_MERGE_DECIMATION_STEP     = 64;
+static const MIL_INT    MAX_FILL_GAPS_THRESHOLD_PIXEL = 64;
+static const MIL_DOUBLE MAX_PLANE_DATA_CROP_BOX_SCALE = 100.0;
+
+// Configuration file.
+static const MIL_STRING FILE_ALIGNMENT_PARAMS = MIL_TEXT("AlignmentParams.cfg");
+
+//****************************************************************************
+// Parameters of the alignment and merge.
+//****************************************************************************
+struct SAlignmentParams
+   {
+   MIL_INT    MergeDecimationStep     = MERGE_DECIMATION_STEP;
+   MIL_INT    FillGapsThresholdPixel  = FILL_GAPS_THRESHOLD_PIXEL;
+   MIL_INT    CircleSearchDetailLevel = CIRCLE_SEARCH_DETAIL_LEVEL;
+   MIL_DOUBLE CircleSearchSmoothness  = CIRCLE_SEARCH_SMOOTHNESS;
+   MIL_DOUBLE CircleSearchAcceptance  = CIRCLE_SEARCH_ACCEPTANCE;
+   MIL_DOUBLE SegmentSearchSmoothness = SEGMENT_SEARCH_SMOOTHNESS;
+   MIL_DOUBLE SegmentSearchAcceptance = SEGMENT_SEARCH_ACCEPTANCE;
+   MIL_DOUBLE PlaneDataCropBoxScale   = PLANE_DATA_CROP_BOX_SCALE;
+   };
+
+//****************************************************************************
+// Names of the detail levels in the configuration file.
+//****************************************************************************
+struct SDetailLevelName
+   {
+   MIL_INT            DetailLevel;
+   const char*        Name;
+   MIL_CONST_TEXT_PTR Label;
+   };
+static const SDetailLevelName DETAIL_LEVEL_NAMES[] =
+   {
+      {M_MEDIUM   , "M_MEDIUM"   , MIL_TEXT("Medium")   },
+      {M_HIGH     , "M_HIGH"     , MIL_TEXT("High")     },
+      {M_VERY_HIGH, "M_VERY_HIGH", MIL_TEXT("Very high")},
+   };
+
+const char* GetDetailLevelName(MIL_INT DetailLevel)
+   {
+   for(const auto& DetailLevelName : DETAIL_LEVEL_NAMES)
+      {
+      if(DetailLevelName.DetailLevel == DetailLevel)
+         return DetailLevelName.Name;
+      }
+   return "M_VERY_HIGH";
+   }
+
+MIL_CONST_TEXT_PTR GetDetailLevelLabel(MIL_INT DetailLevel)
+   {
+   for(const auto& DetailLevelName : DETAIL_LEVEL_NAMES)
+      {
+      if(DetailLevelName.DetailLevel == DetailLevel)
+         return DetailLevelName.Label;
+      }
+   return MIL_TEXT("Very high");
+   }
+
+//****************************************************************************
+// Save the parameters to a configuration file.
+//****************************************************************************
+bool SaveAlignmentParams(const SAlignmentParams& Params, const MIL_STRING& FileName)
+   {
+   std::ofstream File(FileName);
+   File << "# Alignment and merge parameters.\n";
+   File << "MergeDecimationStep = "     << Params.MergeDecimationStep                         << "\n";
+   File << "FillGapsThresholdPixel = "  << Params.FillGapsThresholdPixel                      << "\n";
+   File << "CircleSearchDetailLevel = " << GetDetailLevelName(Params.CircleSearchDetailLevel) << "\n";
+   File << "CircleSearchSmoothness = "  << Params.CircleSearchSmoothness                      << "\n";
+   File << "CircleSearchAcceptance = "  << Params.CircleSearchAcceptance                      << "\n";
+   File << "SegmentSearchSmoothness = " << Params.SegmentSearchSmoothness                     << "\n";
+   File << "SegmentSearchAcceptance = " << Params.SegmentSearchAcceptance                     << "\n";
+   File << "PlaneDataCropBoxScale = "   << Params.PlaneDataCropBoxScale                       << "\n";
+   return File.good();
+   }
+
+//****************************************************************************
+// Parse the value of a parameter. Returns false if the value is not a number
+// within [Min, Max], in which case the parameter is not changed.
+//****************************************************************************
+template <class T>
+bool ParseAlignmentParam(const std::string& Value, T Min, T Max, T& Param)
+   {
+   std::istringstream Stream(Value);
+   T Parsed;
+   if(!(Stream >> Parsed) || !(Parsed >= Min && Parsed <= Max))
+      return false;
+   Param = Parsed;
+   return true;
+   }
+
+//****************************************************************************
+// Restore the parameters from a configuration file. The parameters that are
+// not in the file keep their value; the parameters with an invalid value are
+// reset to their default value. Returns false if the file can't be read.
+//****************************************************************************
+bool LoadAlignmentParams(const MIL_STRING& FileName, SAlignmentParams& Params)
+   {
+   std::ifstream File(FileName);
+   if(!File.is_open())
+      return false;
+
+   std::string Line;
+   while(std::getline(File, Line))
+      {
+      Line = Line.substr(0, Line.find('#'));
+      auto EqualPos = Line.find('=');
+      if(EqualPos == std::string::npos)
+         continue;
+
+      std::string Key, Value;
+      std::istringstream(Line.substr(0, EqualPos)) >> Key;
+      std::istringstream(Line.substr(EqualPos + 1)) >> Value;
+
+      const SAlignmentParams Defaults;
+      bool IsValid = true;
+      if(Key == "MergeDecimationStep")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, (MIL_INT)1, MAX_MERGE_DECIMATION_STEP, Params.MergeDecimationStep)))
+            Params.MergeDecimationStep = Defaults.MergeDecimationStep;
+         }
+      else if(Key == "FillGapsThresholdPixel")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, (MIL_INT)1, MAX_FILL_GAPS_THRESHOLD_PIXEL, Params.FillGapsThresholdPixel)))
+            Params.FillGapsThresholdPixel = Defaults.FillGapsThresholdPixel;
+         }
+      else if(Key == "CircleSearchDetailLevel")
+         {
+         IsValid = false;
+         for(const auto& DetailLevelName : DETAIL_LEVEL_NAMES)
+            {
+            if(Value == DetailLevelName.Name)
+               {
+               Params.CircleSearchDetailLevel = DetailLevelName.DetailLevel;
+               IsValid = true;
+               }
+            }
+         if(!IsValid)
+            Params.CircleSearchDetailLevel = Defaults.CircleSearchDetailLevel;
+         }
+      else if(Key == "CircleSearchSmoothness")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, 0.0, 100.0, Params.CircleSearchSmoothness)))
+            Params.CircleSearchSmoothness = Defaults.CircleSearchSmoothness;
+         }
+      else if(Key == "CircleSearchAcceptance")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, 0.0, 100.0, Params.CircleSearchAcceptance)))
+            Params.CircleSearchAcceptance = Defaults.CircleSearchAcceptance;
+         }
+      else if(Key == "SegmentSearchSmoothness")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, 0.0, 100.0, Params.SegmentSearchSmoothness)))
+            Params.SegmentSearchSmoothness = Defaults.SegmentSearchSmoothness;
+         }
+      else if(Key == "SegmentSearchAcceptance")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, 0.0, 100.0, Params.SegmentSearchAcceptance)))
+            Params.SegmentSearchAcceptance = Defaults.SegmentSearchAcceptance;
+         }
+      else if(Key == "PlaneDataCropBoxScale")
+         {
+         if(!(IsValid = ParseAlignmentParam(Value, 1.0e-3, MAX_PLANE_DATA_CROP_BOX_SCALE, Params.PlaneDataCropBoxScale)))
+            Params.PlaneDataCropBoxScale = Defaults.PlaneDataCropBoxScale;
+         }
+      else if(!Key.empty())
+         MosPrintf(MIL_TEXT("Unknown alignment parameter %s ignored.\n"), MIL_STRING(Key.begin(), Key.end()).c_str());
+
+      if(!IsValid)
+         MosPrintf(MIL_TEXT("Invalid value of the alignment parameter %s. The default value is used.\n"),
+                   MIL_STRING(Key.begin(), Key.end()).c_str());
+      }
+
+   return true;
+   }
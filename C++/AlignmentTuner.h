@@ -0,0 +1,465 @@
+﻿//***************************************************************************************/
+// 
+// File name: AlignmentTuner.h
+//
+// Synopsis: Implementation of the tool that sweeps the alignment and merge parameters
+//           over a set of scans, measures the runtime, the deviation of the resulting
+//           matrices from a measured reference calibration and the point spacing of the
+//           merge, and selects the fastest parameters on the Pareto frontier.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <algorithm>
+#include <fstream>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+static const MIL_STRING FILE_TUNING_RESULTS = MIL_TEXT("AlignmentTuning.csv");
+
+// Measured reference calibration of the cameras. The tuner never writes these files; without
+// them, the accuracy of the alignment can't be measured and only the merge is tuned.
+static const MIL_STRING FILE_REFERENCE_MATRIX_PREFIX = MIL_TEXT("ReferenceMatrixMR");
+
+// Swept values. The circle and segment searches share the smoothness and acceptance values.
+static const MIL_INT    TUNING_FILL_GAPS_THRESHOLDS[] = {1, 2, 4};
+static const MIL_INT    TUNING_DETAIL_LEVELS[]        = {M_MEDIUM, M_HIGH, M_VERY_HIGH};
+static const MIL_DOUBLE TUNING_SMOOTHNESSES[]         = {50.0, 70.0, 90.0};
+static const MIL_DOUBLE TUNING_ACCEPTANCES[]          = {60.0, 75.0};
+static const MIL_DOUBLE TUNING_CROP_BOX_SCALES[]      = {1.5, 2.0};
+static const MIL_INT    TUNING_DECIMATION_STEPS[]     = {1, 2, 4, 8};   // The first step must be 1.
+
+// Each candidate is run once; the candidates on the Pareto frontier are then rerun a few
+// times and their fastest run is kept. The merge of each decimation step is timed the same way.
+static const MIL_INT TUNING_NB_REPETITIONS = 3;
+
+// The deviation of a matrix is its translation deviation plus the displacement caused
+// by its rotation deviation at the lever arm distance, in mm.
+static const MIL_DOUBLE TUNING_ROTATION_LEVER_ARM = 100.0;
+static const MIL_DOUBLE TUNING_MAX_DEVIATION      = 0.05;
+
+// The quality of the merge is the mean spacing of its points relative to the merge without
+// decimation, which is the square root of the ratio of their numbers of points.
+static const MIL_DOUBLE TUNING_MAX_SPACING_RATIO  = 4.0;
+
+//****************************************************************************
+// Result of the alignment with one set of parameters.
+//****************************************************************************
+struct STuningRun
+   {
+   SAlignmentParams Params;
+   bool       IsValid                 = false;
+   bool       IsOnFrontier            = false;
+   MIL_DOUBLE AlignmentTime           = 0.0; // in s
+   MIL_DOUBLE MaxTranslationDeviation = 0.0; // in mm
+   MIL_DOUBLE MaxRotationDeviation    = 0.0; // in degrees
+   MIL_DOUBLE Deviation               = 0.0; // in mm
+   MIL_DOUBLE MergeTime               = 0.0; // in s
+   MIL_DOUBLE SpacingRatio            = 0.0;
+
+   MIL_DOUBLE Time() const { return AlignmentTime + MergeTime; }
+   };
+
+//****************************************************************************
+// Merge of the aligned scans with one decimation step.
+//****************************************************************************
+struct SMergeTuningRun
+   {
+   MIL_INT    DecimationStep = 1;
+   MIL_DOUBLE MergeTime      = 0.0; // in s
+   MIL_INT    NbPoints       = 0;
+   MIL_DOUBLE SpacingRatio   = 0.0;
+   };
+
+//****************************************************************************
+// Compute the transformation matrices of all the scans without any display.
+//****************************************************************************
+bool ComputeAlignmentMatrices(MIL_ID MilSystem, const std::vector<MIL_ID>& MilPointClouds,
+                              const SAlignmentParams& Params, MIL_INT BarHolesDistanceX,
+                              std::vector<MIL_UNIQUE_3DGEO_ID>& MilMatrices)
+   {
+   MIL_DOUBLE RefCircleXPos = 0.0;
+   MIL_DOUBLE RefCircleYPos = 0.0;
+   SPredictedSearchRegions SearchRegions;
+   MilMatrices.clear();
+
+   for(MIL_INT i = 0; i < (MIL_INT)MilPointClouds.size(); i++)
+      {
+      auto FindBarPlaneResult = FindRotationYAndTranslationZ(MilSystem, MilPointClouds[i], M_NULL, SILENT_ITERATION, Params);
+      if(!FindBarPlaneResult.IsValid)
+         return false;
+
+      MIL_UNIQUE_BUF_ID MilDepthMap = CreateDepthMap(MilSystem, FindBarPlaneResult.MilTransformedPointCloud, Params);
+
+      auto Features = FindBarFeatures(MilSystem, M_NULL, MilDepthMap, SILENT_ITERATION, Params, SearchRegions);
+      if(Features.NbCircles < 1 || Features.NbSegments < 1)
+         return false;
+
+      MIL_INT EdgeIndex;
+      SUnitVector2d AxisVector = GetAxisFromSegments(Features.MilSegmentResult, M_NULL, SILENT_ITERATION, &EdgeIndex);
+      SearchRegions.UpdateCircleRegion(Features.MilCircleResult, MilDepthMap, Features.CircleSearchOffsetY);
+      SearchRegions.UpdateSegmentRegion(Features.MilSegmentResult, EdgeIndex, MilDepthMap, Features.SegmentSearchOffsetY);
+      if(i == 0)
+         {
+         RefCircleXPos = Features.CircleXPos;
+         RefCircleYPos = Features.CircleYPos;
+         }
+
+      auto MilTransformMatrix = M3dgeoAlloc(M_DEFAULT_HOST, M_TRANSFORMATION_MATRIX, M_DEFAULT, M_UNIQUE_ID);
+      GetMatrixTransform(MilTransformMatrix, AxisVector, RefCircleXPos, RefCircleYPos, Features.CircleXPos, Features.CircleYPos, i * BarHolesDistanceX);
+      ComposeBarPlaneTransform(MilTransformMatrix, FindBarPlaneResult.Transformation);
+      MilMatrices.push_back(std::move(MilTransformMatrix));
+      }
+
+   return true;
+   }
+
+//****************************************************************************
+// Get the deviation of the matrices from the reference matrices.
+//****************************************************************************
+void GetMatricesDeviation(const std::vector<MIL_UNIQUE_3DGEO_ID>& MilMatrices, const std::vector<MIL_ID>& MilRefMatrices,
+                          STuningRun& Run)
+   {
+   Run.MaxTranslationDeviation = 0.0;
+   Run.MaxRotationDeviation = 0.0;
+   Run.Deviation = 0.0;
+   for(size_t i = 0; i < MilMatrices.size(); i++)
+      {
+      MIL_DOUBLE T[3], RefT[3], R[3], RefR[3];
+      M3dgeoMatrixGetTransform(MilMatrices[i], M_TRANSLATION, &T[0], &T[1], &T[2], M_NULL, M_DEFAULT);
+      M3dgeoMatrixGetTransform(MilRefMatrices[i], M_TRANSLATION, &RefT[0], &RefT[1], &RefT[2], M_NULL, M_DEFAULT);
+      M3dgeoMatrixGetTransform(MilMatrices[i], M_ROTATION_XYZ, &R[0], &R[1], &R[2], M_NULL, M_DEFAULT);
+      M3dgeoMatrixGetTransform(MilRefMatrices[i], M_ROTATION_XYZ, &RefR[0], &RefR[1], &RefR[2], M_NULL, M_DEFAULT);
+
+      MIL_DOUBLE TranslationDeviation = 0.0;
+      MIL_DOUBLE RotationDeviation = 0.0;
+      for(MIL_INT a = 0; a < 3; a++)
+         {
+         TranslationDeviation += (T[a] - RefT[a]) * (T[a] - RefT[a]);
+         MIL_DOUBLE AngleDeviation = fmod(fabs(R[a] - RefR[a]), 360.0);
+         RotationDeviation = std::max(RotationDeviation, std::min(AngleDeviation, 360.0 - AngleDeviation));
+         }
+      TranslationDeviation = sqrt(TranslationDeviation);
+
+      Run.MaxTranslationDeviation = std::max(Run.MaxTranslationDeviation, TranslationDeviation);
+      Run.MaxRotationDeviation = std::max(Run.MaxRotationDeviation, RotationDeviation);
+      Run.Deviation = std::max(Run.Deviation, TranslationDeviation + TUNING_ROTATION_LEVER_ARM * RotationDeviation * DIV_PI_180);
+      }
+   }
+
+//****************************************************************************
+// Restore the measured reference calibration of the cameras. Returns false,
+// without creating anything, if the reference files are missing.
+//****************************************************************************
+bool RestoreReferenceMatrices(MIL_ID MilSystem, MIL_INT NbCameras, std::vector<MIL_UNIQUE_3DGEO_ID>& MilRefMatrices)
+   {
+   auto BuildReferenceMatrixName = [](MIL_INT i) { return FILE_REFERENCE_MATRIX_PREFIX + M_TO_STRING(i + 1) + MIL_TEXT(".m3dgeo"); };
+
+   MilRefMatrices.clear();
+   for(MIL_INT i = 0; i < NbCameras; i++)
+      {
+      MIL_INT FilePresent = M_NO;
+      MappFileOperation(M_DEFAULT, BuildReferenceMatrixName(i), M_NULL, M_NULL, M_FILE_EXISTS, M_DEFAULT, &FilePresent);
+      if(FilePresent != M_YES)
+         {
+         MosPrintf(MIL_TEXT("The measured reference calibration %s*.m3dgeo is missing. The accuracy of\n")
+                   MIL_TEXT("the alignment can't be measured, so the alignment parameters are kept and\n")
+                   MIL_TEXT("only the merge decimation step is tuned.\n\n"), FILE_REFERENCE_MATRIX_PREFIX.c_str());
+         MilRefMatrices.clear();
+         return false;
+         }
+      MilRefMatrices.push_back(M3dgeoRestore(BuildReferenceMatrixName(i), MilSystem, M_DEFAULT, M_UNIQUE_ID));
+      }
+   return true;
+   }
+
+//****************************************************************************
+// Mark the runs on the Pareto frontier: no other run is at least as fast, as
+// accurate and as dense, and better in one of them. The deviation is ignored
+// when it isn't measured. Returns the indices of the frontier runs sorted by
+// runtime.
+//****************************************************************************
+std::vector<size_t> FindParetoFrontier(std::vector<STuningRun>& Runs, bool HasDeviation)
+   {
+   std::vector<size_t> Order;
+   for(size_t r = 0; r < Runs.size(); r++)
+      {
+      Runs[r].IsOnFrontier = false;
+      if(Runs[r].IsValid)
+         Order.push_back(r);
+      }
+   std::sort(Order.begin(), Order.end(), [&Runs](size_t a, size_t b)
+      {
+      return Runs[a].Time() < Runs[b].Time();
+      });
+
+   // A run dominated by any faster run is also dominated by a run of the frontier.
+   std::vector<size_t> Frontier;
+   for(auto r : Order)
+      {
+      bool IsDominated = false;
+      for(auto f : Frontier)
+         {
+         if((!HasDeviation || Runs[f].Deviation <= Runs[r].Deviation) && Runs[f].SpacingRatio <= Runs[r].SpacingRatio)
+            {
+            IsDominated = true;
+            break;
+            }
+         }
+      if(!IsDominated)
+         {
+         Runs[r].IsOnFrontier = true;
+         Frontier.push_back(r);
+         }
+      }
+   return Frontier;
+   }
+
+//****************************************************************************
+// Print a tuning run.
+//****************************************************************************
+void PrintTuningRun(const STuningRun& Run, bool HasDeviation)
+   {
+   const auto& P = Run.Params;
+   MosPrintf(MIL_TEXT("|%5d|%12s|%6.0f|%6.0f|%6.1f|%5d|%9.1f|"),
+             (int)P.FillGapsThresholdPixel, GetDetailLevelLabel(P.CircleSearchDetailLevel),
+             P.CircleSearchSmoothness, P.CircleSearchAcceptance, P.PlaneDataCropBoxScale, (int)P.MergeDecimationStep,
+             Run.Time() * 1000.0);
+   if(HasDeviation)
+      MosPrintf(MIL_TEXT("%9.4f|%9.4f|"), Run.MaxTranslationDeviation, Run.MaxRotationDeviation);
+   else
+      MosPrintf(MIL_TEXT("%9s|%9s|"), MIL_TEXT("n/a"), MIL_TEXT("n/a"));
+   MosPrintf(MIL_TEXT("%7.2f|\n"), Run.SpacingRatio);
+   }
+
+//****************************************************************************
+// Time the merge of the aligned scans with each decimation step, and measure
+// the spacing of the merged points relative to the merge without decimation.
+//****************************************************************************
+std::vector<SMergeTuningRun> TuneMergeDecimation(MIL_ID MilSystem, const std::vector<MIL_ID>& MilPointClouds,
+                                                 const std::vector<MIL_UNIQUE_3DGEO_ID>& MilMatrices)
+   {
+   std::vector<MIL_UNIQUE_BUF_ID> MilAlignedPointClouds;
+   std::vector<MIL_ID> MilAlignedPointCloudIds;
+   for(size_t i = 0; i < MilPointClouds.size(); i++)
+      {
+      MilAlignedPointClouds.push_back(MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID));
+      M3dimMatrixTransform(MilPointClouds[i], MilAlignedPointClouds.back(), MilMatrices[i], M_DEFAULT);
+      MilAlignedPointCloudIds.push_back(MilAlignedPointClouds.back());
+      }
+
+   auto MilStatResult = M3dimAllocResult(MilSystem, M_STATISTICS_RESULT, M_DEFAULT, M_UNIQUE_ID);
+   std::vector<SMergeTuningRun> MergeRuns;
+   for(auto DecimationStep : TUNING_DECIMATION_STEPS)
+      {
+      auto MilSubsampleContext = M3dimAlloc(MilSystem, M_SUBSAMPLE_CONTEXT, M_DEFAULT, M_UNIQUE_ID);
+      M3dimControl(MilSubsampleContext, M_SUBSAMPLE_MODE, M_SUBSAMPLE_DECIMATE);
+      M3dimControl(MilSubsampleContext, M_ORGANIZATION_TYPE, M_ORGANIZED);
+      M3dimControl(MilSubsampleContext, M_STEP_SIZE_X, DecimationStep);
+      M3dimControl(MilSubsampleContext, M_STEP_SIZE_Y, DecimationStep);
+      auto MilMergedPointCloud = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+
+      SMergeTuningRun MergeRun;
+      MergeRun.DecimationStep = DecimationStep;
+      MergeRun.MergeTime = -1.0;
+      for(MIL_INT Rep = 0; Rep < TUNING_NB_REPETITIONS; Rep++)
+         {
+         MIL_DOUBLE StartTime, EndTime;
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &StartTime);
+         M3dimMerge(MilAlignedPointCloudIds, MilMergedPointCloud, M_DEFAULT, MilSubsampleContext, M_DEFAULT);
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &EndTime);
+         if(MergeRun.MergeTime < 0.0 || EndTime - StartTime < MergeRun.MergeTime)
+            MergeRun.MergeTime = EndTime - StartTime;
+         }
+
+      M3dimStat(M_STAT_CONTEXT_NUMBER_OF_POINTS, MilMergedPointCloud, MilStatResult, M_DEFAULT);
+      M3dimGetResult(MilStatResult, M_NUMBER_OF_POINTS_VALID, &MergeRun.NbPoints);
+      if(MergeRun.NbPoints > 0 && !MergeRuns.empty() && MergeRuns[0].NbPoints > 0)
+         MergeRun.SpacingRatio = sqrt(static_cast<MIL_DOUBLE>(MergeRuns[0].NbPoints) / MergeRun.NbPoints);
+      else
+         MergeRun.SpacingRatio = MergeRun.NbPoints > 0 ? 1.0 : std::numeric_limits<MIL_DOUBLE>::max();
+      MergeRuns.push_back(MergeRun);
+      }
+
+   MosPrintf(MIL_TEXT("|-----------|---------|-------------|-------|\n"));
+   MosPrintf(MIL_TEXT("| Decimation| Time(ms)| Nb points   |Spacing|\n"));
+   MosPrintf(MIL_TEXT("|-----------|---------|-------------|-------|\n"));
+   for(const auto& MergeRun : MergeRuns)
+      {
+      MosPrintf(MIL_TEXT("|%11d|%9.1f|%13d|%7.2f|\n"), (int)MergeRun.DecimationStep, MergeRun.MergeTime * 1000.0,
+                (int)MergeRun.NbPoints, MergeRun.SpacingRatio);
+      }
+   MosPrintf(MIL_TEXT("\n"));
+   return MergeRuns;
+   }
+
+//****************************************************************************
+// Sweep the parameters over the scans and save the selected parameters.
+// MilPointClouds are the scans of the bar with holes (with normals) and
+// MilRefMatrices the measured reference calibration of each camera. Without a
+// reference calibration, the alignment parameters are kept and only the merge
+// decimation step is tuned.
+//****************************************************************************
+SAlignmentParams TuneAlignmentParameters(MIL_ID MilSystem, const std::vector<MIL_ID>& MilPointClouds,
+                                         const std::vector<MIL_ID>& MilRefMatrices,
+                                         const SAlignmentParams& CurrentParams, MIL_INT BarHolesDistanceX)
+   {
+   const bool HasDeviation = !MilRefMatrices.empty();
+   if(HasDeviation)
+      {
+      MosPrintf(MIL_TEXT("The alignment parameters are swept to find the fastest ones that keep\n")
+                MIL_TEXT("the matrices within %.3f mm of the reference calibration.\n\n"), TUNING_MAX_DEVIATION);
+      }
+
+   std::vector<MIL_UNIQUE_3DGEO_ID> MilMatrices;
+   auto RunCandidate = [&](STuningRun& Run)
+      {
+      MIL_DOUBLE StartTime, EndTime;
+      MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &StartTime);
+      bool IsValid = ComputeAlignmentMatrices(MilSystem, MilPointClouds, Run.Params, BarHolesDistanceX, MilMatrices);
+      MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &EndTime);
+      return IsValid ? EndTime - StartTime : -1.0;
+      };
+
+   // Build the candidates. Without a reference calibration, the current parameters are the only candidate.
+   std::vector<STuningRun> AlignmentRuns;
+   if(HasDeviation)
+      {
+      for(auto FillGapsThreshold : TUNING_FILL_GAPS_THRESHOLDS)
+         for(auto DetailLevel : TUNING_DETAIL_LEVELS)
+            for(auto Smoothness : TUNING_SMOOTHNESSES)
+               for(auto Acceptance : TUNING_ACCEPTANCES)
+                  for(auto CropBoxScale : TUNING_CROP_BOX_SCALES)
+                     {
+                     STuningRun Run;
+                     Run.Params = CurrentParams;
+                     Run.Params.FillGapsThresholdPixel = FillGapsThreshold;
+                     Run.Params.CircleSearchDetailLevel = DetailLevel;
+                     Run.Params.CircleSearchSmoothness = Smoothness;
+                     Run.Params.SegmentSearchSmoothness = Smoothness;
+                     Run.Params.CircleSearchAcceptance = Acceptance;
+                     Run.Params.SegmentSearchAcceptance = Acceptance;
+                     Run.Params.PlaneDataCropBoxScale = CropBoxScale;
+                     AlignmentRuns.push_back(Run);
+                     }
+      }
+   else
+      {
+      STuningRun Run;
+      Run.Params = CurrentParams;
+      AlignmentRuns.push_back(Run);
+      }
+
+   // Run each candidate once. A key press stops the sweep; the candidates run so far are kept.
+   MIL_DOUBLE SweepStartTime, CurrentTime;
+   MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &SweepStartTime);
+   for(size_t r = 0; r < AlignmentRuns.size(); r++)
+      {
+      MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &CurrentTime);
+      MIL_DOUBLE RemainingTime = r > 0 ? (CurrentTime - SweepStartTime) * (AlignmentRuns.size() - r) / r : 0.0;
+      MosPrintf(MIL_TEXT("Running candidate %d of %d, about %.0f s left. Press any key to stop...\r"),
+                (int)(r + 1), (int)AlignmentRuns.size(), RemainingTime);
+      if(MosKbhit())
+         {
+         MosGetch();
+         MosPrintf(MIL_TEXT("\nThe sweep was stopped after %d candidates."), (int)r);
+         break;
+         }
+
+      AlignmentRuns[r].AlignmentTime = RunCandidate(AlignmentRuns[r]);
+      AlignmentRuns[r].IsValid = AlignmentRuns[r].AlignmentTime >= 0.0;
+      if(AlignmentRuns[r].IsValid && HasDeviation)
+         GetMatricesDeviation(MilMatrices, MilRefMatrices, AlignmentRuns[r]);
+      }
+   MosPrintf(MIL_TEXT("\n\n"));
+
+   // Rerun the candidates of the alignment frontier to keep their fastest runtime.
+   for(auto r : FindParetoFrontier(AlignmentRuns, HasDeviation))
+      {
+      for(MIL_INT Rep = 1; Rep < TUNING_NB_REPETITIONS; Rep++)
+         {
+         MIL_DOUBLE Time = RunCandidate(AlignmentRuns[r]);
+         if(Time >= 0.0)
+            AlignmentRuns[r].AlignmentTime = std::min(AlignmentRuns[r].AlignmentTime, Time);
+         }
+      }
+
+   // Merge the scans aligned with the current parameters with each decimation step.
+   // The decimation doesn't change the matrices, only the merge time and the point spacing.
+   STuningRun CurrentRun;
+   CurrentRun.Params = CurrentParams;
+   if(RunCandidate(CurrentRun) < 0.0)
+      {
+      MosPrintf(MIL_TEXT("The scans can't be aligned with the current parameters. The tuning is skipped.\n\n"));
+      return CurrentParams;
+      }
+   auto MergeRuns = TuneMergeDecimation(MilSystem, MilPointClouds, MilMatrices);
+
+   // Combine the alignment candidates with the decimation steps.
+   std::vector<STuningRun> Runs;
+   for(const auto& AlignmentRun : AlignmentRuns)
+      {
+      if(!AlignmentRun.IsValid)
+         continue;
+      for(const auto& MergeRun : MergeRuns)
+         {
+         STuningRun Run = AlignmentRun;
+         Run.Params.MergeDecimationStep = MergeRun.DecimationStep;
+         Run.MergeTime = MergeRun.MergeTime;
+         Run.SpacingRatio = MergeRun.SpacingRatio;
+         Runs.push_back(Run);
+         }
+      }
+
+   // Report the Pareto frontier.
+   auto Frontier = FindParetoFrontier(Runs, HasDeviation);
+   MosPrintf(MIL_TEXT("Speed/accuracy/density Pareto frontier:\n\n"));
+   MosPrintf(MIL_TEXT("|-----|------------|------|------|------|-----|---------|---------|---------|-------|\n"));
+   MosPrintf(MIL_TEXT("| Fill|   Detail   |Smooth|Accept| Crop | Step| Time(ms)| Dev T   | Dev R   |Spacing|\n"));
+   MosPrintf(MIL_TEXT("|-----|------------|------|------|------|-----|---------|---------|---------|-------|\n"));
+   for(auto r : Frontier)
+      PrintTuningRun(Runs[r], HasDeviation);
+   MosPrintf(MIL_TEXT("\n"));
+
+   // Save all the runs.
+   std::ofstream ResultFile(FILE_TUNING_RESULTS);
+   ResultFile << "FillGapsThresholdPixel,CircleSearchDetailLevel,Smoothness,Acceptance,PlaneDataCropBoxScale,MergeDecimationStep,"
+                 "IsValid,AlignmentTime,MergeTime,MaxTranslationDeviation,MaxRotationDeviation,Deviation,SpacingRatio,IsOnFrontier\n";
+   for(const auto& Run : Runs)
+      {
+      ResultFile << Run.Params.FillGapsThresholdPixel << "," << GetDetailLevelName(Run.Params.CircleSearchDetailLevel) << ","
+                 << Run.Params.CircleSearchSmoothness << "," << Run.Params.CircleSearchAcceptance << ","
+                 << Run.Params.PlaneDataCropBoxScale << "," << Run.Params.MergeDecimationStep << ","
+                 << Run.IsValid << "," << Run.AlignmentTime << "," << Run.MergeTime << ",";
+      if(HasDeviation)
+         ResultFile << Run.MaxTranslationDeviation << "," << Run.MaxRotationDeviation << "," << Run.Deviation << ",";
+      else
+         ResultFile << ",,,";
+      ResultFile << Run.SpacingRatio << "," << Run.IsOnFrontier << "\n";
+      }
+
+   // Select the fastest parameters within the accepted deviation and point spacing.
+   SAlignmentParams SelectedParams = CurrentParams;
+   bool IsSelected = false;
+   for(auto r : Frontier)
+      {
+      if((!HasDeviation || Runs[r].Deviation <= TUNING_MAX_DEVIATION) && Runs[r].SpacingRatio <= TUNING_MAX_SPACING_RATIO)
+         {
+         SelectedParams = Runs[r].Params;
+         IsSelected = true;
+         break;
+         }
+      }
+
+   if(IsSelected && SaveAlignmentParams(SelectedParams, FILE_ALIGNMENT_PARAMS))
+      {
+      MosPrintf(MIL_TEXT("The selected parameters (decimation step %d) were saved to %s and\n"),
+                (int)SelectedParams.MergeDecimationStep, FILE_ALIGNMENT_PARAMS.c_str());
+      MosPrintf(MIL_TEXT("all the runs to %s.\n\n"), FILE_TUNING_RESULTS.c_str());
+      }
+   else
+      MosPrintf(MIL_TEXT("No parameters are within the accepted deviation and spacing. The current ones are kept.\n\n"));
+
+   return SelectedParams;
+   }
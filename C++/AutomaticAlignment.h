@@ -9,6 +9,9 @@
 // All Rights Reserved
 //*************************************************************************************/
 #include<mil.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 //*****************************************************************************
 // Constants.
@@ -16,23 +19,31 @@
 static const MIL_DOUBLE DIV_PI_180 = 0.017453292519943295769236907684886;
 static const MIL_DOUBLE DIV_180_PI = 57.295779513082320866997945294156;
 
-// Depth map.
-static const MIL_INT FILL_GAPS_THRESHOLD_PIXEL = 2;
-
 // Hole circles.
 static const MIL_INT    MAX_NUMBER_OF_HOLE_CIRCLES       = 18;
-static const MIL_DOUBLE CIRCLE_SEARCH_SMOOTHNESS         = 90.0;
-static const MIL_DOUBLE CIRCLE_SEARCH_ACCEPTANCE         = 75.0;
 static const MIL_DOUBLE CIRCLE_SEARCH_SAGITTA_TOLERANCE  = 50.0;
 static const MIL_DOUBLE HOLE_RADIUS                      = 20.0;
 
 // Bar segments.
 static const MIL_INT    MAX_NUMBER_OF_SEGMENTS    = 30;
-static const MIL_DOUBLE SEGMENT_SEARCH_SMOOTHNESS = 90.0;
-static const MIL_DOUBLE SEGMENT_SEARCH_ACCEPTANCE = 75.0;
 static const MIL_INT    SEGMENT_LENGTH            = 100;
 static const MIL_DOUBLE MIN_VALID_SEGMENT_X       = 15;
 
+// Predicted search regions. After the first camera, the searches are restricted to
+// a band of the depth map around the Y positions of the previously found holes and edge.
+// The search falls back to the whole depth map if the band gives fewer shapes than the
+// matrix computation needs (the best hole and one edge) or a best score more than the
+// tolerance below the previous camera. Disabled until a speedup is measured on the
+// target scans with the search region benchmark.
+static const bool       USE_PREDICTED_SEARCH_REGIONS       = false;
+static const MIL_DOUBLE PREDICTED_REGION_MARGIN_Y          = 2.0 * HOLE_RADIUS;
+static const MIL_DOUBLE PREDICTED_REGION_SCORE_TOLERANCE   = 10.0;
+static const MIL_INT    PREDICTED_REGION_MIN_NB_RESULTS    = 1;
+static const MIL_INT    PREDICTED_SEARCH_NB_REPETITIONS    = 5;
+
+// Iteration index used to run the alignment steps without printing or drawing.
+static const MIL_INT SILENT_ITERATION = -1;
+
 //****************************************************************************
 // Structure representing an axis with a position and direction.
 //****************************************************************************
@@ -52,9 +63,12 @@ struct SUnitVector2d
    };
 
 //****************************************************************************
-// Create depth map.
+// Create depth map. With more than one worker, the projection and the gap
+// filling are done by tiles in parallel, which is only the default when the
+// tiled depth map is enabled.
 //****************************************************************************
-MIL_UNIQUE_BUF_ID CreateDepthMap(MIL_ID MilSystem, MIL_ID MilPointCloud)
+MIL_UNIQUE_BUF_ID CreateDepthMap(MIL_ID MilSystem, MIL_ID MilPointCloud, const SAlignmentParams& Params,
+                                 MIL_INT NbWorkers = USE_TILED_DEPTH_MAP ? GetNbWorkers() : 1)
    {
    // Set the pixel size aspect ratio to be unity.
    const MIL_DOUBLE PixelAspectRatio = 1.0;
@@ -73,11 +87,17 @@ MIL_UNIQUE_BUF_ID CreateDepthMap(MIL_ID MilSystem, MIL_ID MilPointCloud)
    // Calibrate the depth map based on the given point cloud.
    M3dimCalibrateDepthMap(MilPointCloud, MilDepthMap, M_NULL, M_NULL, PixelAspectRatio, M_DEFAULT, M_DEFAULT);
 
+   // Project and fill the gaps by tiles, in the depth map and in a scratch depth map with the same calibration.
+   if(NbWorkers > 1)
+      {
+      auto MilScratchDepthMap = MbufAlloc2d(MilSystem, DepthMapSizeX, DepthMapSizeY + 5, M_UNSIGNED + 8, M_IMAGE | M_PROC, M_UNIQUE_ID);
+      M3dimCalibrateDepthMap(MilPointCloud, MilScratchDepthMap, M_NULL, M_NULL, PixelAspectRatio, M_DEFAULT, M_DEFAULT);
+      if(ProjectAndFillGapsTiled(MilSystem, MilPointCloud, MilDepthMap, MilScratchDepthMap, Params.FillGapsThresholdPixel, NbWorkers))
+         return MilDepthMap;
+      }
+
    // Control the options of the fill gap context to yield better results.
-   MIL_UNIQUE_3DIM_ID MilFillGapsContext = M3dimAlloc(MilSystem, M_FILL_GAPS_CONTEXT, M_DEFAULT, M_UNIQUE_ID);
-   M3dimControl(MilFillGapsContext, M_FILL_THRESHOLD_X, FILL_GAPS_THRESHOLD_PIXEL);
-   M3dimControl(MilFillGapsContext, M_FILL_THRESHOLD_Y, FILL_GAPS_THRESHOLD_PIXEL);
-   M3dimControl(MilFillGapsContext, M_INPUT_UNITS, M_PIXEL);
+   auto MilFillGapsContext = AllocFillGapsContext(MilSystem, Params.FillGapsThresholdPixel);
 
    // Project the point cloud in a point based mode.
    M3dimProject(MilPointCloud, MilDepthMap, M_NULL, M_POINT_BASED, M_DEFAULT, M_DEFAULT, M_DEFAULT);
@@ -86,6 +106,67 @@ MIL_UNIQUE_BUF_ID CreateDepthMap(MIL_ID MilSystem, MIL_ID MilPointCloud)
    return MilDepthMap;
    }
 
+//****************************************************************************
+// Benchmark the tiled depth map creation against the number of workers. The
+// depth maps are compared to the one created in a single pass, with the MIL
+// multiprocessing. Returns true if all the depth maps are the same.
+//****************************************************************************
+bool BenchmarkDepthMapCreation(MIL_ID MilSystem, MIL_ID MilPointCloud, const SAlignmentParams& Params)
+   {
+   static const MIL_INT NB_REPETITIONS = 5;
+
+   auto TimeDepthMapCreation = [&](MIL_INT NbWorkers, MIL_UNIQUE_BUF_ID& MilDepthMap)
+      {
+      MIL_DOUBLE BestTime = -1.0;
+      for(MIL_INT Rep = 0; Rep < NB_REPETITIONS; Rep++)
+         {
+         MIL_DOUBLE StartTime, EndTime;
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &StartTime);
+         MilDepthMap = CreateDepthMap(MilSystem, MilPointCloud, Params, NbWorkers);
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &EndTime);
+         if(BestTime < 0.0 || EndTime - StartTime < BestTime)
+            BestTime = EndTime - StartTime;
+         }
+      return BestTime;
+      };
+
+   MIL_UNIQUE_BUF_ID MilRefDepthMap;
+   MIL_DOUBLE RefTime = TimeDepthMapCreation(1, MilRefDepthMap);
+   std::vector<MIL_UINT8> RefData;
+   MbufGet(MilRefDepthMap, RefData);
+
+   MosPrintf(MIL_TEXT("Depth map creation scaling (%d x %d).\n"),
+             (int)MbufInquire(MilRefDepthMap, M_SIZE_X, M_NULL), (int)MbufInquire(MilRefDepthMap, M_SIZE_Y, M_NULL));
+   MosPrintf(MIL_TEXT("The single pass uses the MIL multiprocessing; the tiles use one core per worker.\n\n"));
+   MosPrintf(MIL_TEXT("|--------|---------|---------|---------|\n"));
+   MosPrintf(MIL_TEXT("| Workers| Time(ms)| Speedup | Result  |\n"));
+   MosPrintf(MIL_TEXT("|--------|---------|---------|---------|\n"));
+   MosPrintf(MIL_TEXT("|  single|%9.1f|%9.2f|%9s|\n"), RefTime * 1000.0, 1.0, MIL_TEXT("ref"));
+
+   // Double the number of workers up to the number of cores.
+   const MIL_INT MaxNbWorkers = GetNbWorkers();
+   std::vector<MIL_INT> NbWorkersSteps;
+   for(MIL_INT NbWorkers = 2; NbWorkers < MaxNbWorkers; NbWorkers *= 2)
+      NbWorkersSteps.push_back(NbWorkers);
+   if(MaxNbWorkers > 1)
+      NbWorkersSteps.push_back(MaxNbWorkers);
+
+   bool AreAllSame = true;
+   for(auto NbWorkers : NbWorkersSteps)
+      {
+      MIL_UNIQUE_BUF_ID MilDepthMap;
+      MIL_DOUBLE Time = TimeDepthMapCreation(NbWorkers, MilDepthMap);
+      std::vector<MIL_UINT8> Data;
+      MbufGet(MilDepthMap, Data);
+      bool IsSame = Data == RefData;
+      AreAllSame = AreAllSame && IsSame;
+      MosPrintf(MIL_TEXT("|%8d|%9.1f|%9.2f|%9s|\n"), (int)NbWorkers, Time * 1000.0, RefTime / Time,
+                IsSame ? MIL_TEXT("same") : MIL_TEXT("DIFFERS"));
+      }
+   MosPrintf(MIL_TEXT("\n"));
+   return AreAllSame;
+   }
+
 //****************************************************************************
 // Circle shape finder parameters and results management.
 //****************************************************************************
@@ -95,11 +176,11 @@ struct SCircleShapeParamAndResult
    static const MIL_INT ShapeDefineType = M_CIRCLE;
    static const MIL_CONST_TEXT_PTR FindMessage() { return MIL_TEXT("Circle finder is used to find the position of the bar.\n\n"); }
 
-   static void SetupShapeContextResult(MIL_ID MilSearchContext, MIL_ID MilResult)
+   static void SetupShapeContextResult(MIL_ID MilSearchContext, MIL_ID MilResult, const SAlignmentParams& Params)
       {
-      MmodControl(MilSearchContext, M_CONTEXT, M_DETAIL_LEVEL, M_VERY_HIGH);
-      MmodControl(MilSearchContext, M_CONTEXT, M_SMOOTHNESS, CIRCLE_SEARCH_SMOOTHNESS);
-      MmodControl(MilSearchContext, M_ALL, M_ACCEPTANCE, CIRCLE_SEARCH_ACCEPTANCE);
+      MmodControl(MilSearchContext, M_CONTEXT, M_DETAIL_LEVEL, Params.CircleSearchDetailLevel);
+      MmodControl(MilSearchContext, M_CONTEXT, M_SMOOTHNESS, Params.CircleSearchSmoothness);
+      MmodControl(MilSearchContext, M_ALL, M_ACCEPTANCE, Params.CircleSearchAcceptance);
       MmodControl(MilSearchContext, M_ALL, M_SAGITTA_TOLERANCE, CIRCLE_SEARCH_SAGITTA_TOLERANCE);
       MmodControl(MilSearchContext, 0, M_NUMBER, MAX_NUMBER_OF_HOLE_CIRCLES);
       MmodControl(MilResult, M_GENERAL, M_RESULT_OUTPUT_UNITS, M_WORLD);
@@ -133,10 +214,10 @@ struct SSegmentShapeParamAndResult
    static const MIL_INT ShapeDefineType = M_SEGMENT;
    static const MIL_CONST_TEXT_PTR FindMessage() { return MIL_TEXT("Segment finder is used to find the displacement axis.\n\n"); }
 
-   static void SetupShapeContextResult(MIL_ID MilSearchContext, MIL_ID MilResult)
+   static void SetupShapeContextResult(MIL_ID MilSearchContext, MIL_ID MilResult, const SAlignmentParams& Params)
       {
-      MmodControl(MilSearchContext, M_CONTEXT, M_SMOOTHNESS, SEGMENT_SEARCH_SMOOTHNESS);
-      MmodControl(MilSearchContext, M_ALL, M_ACCEPTANCE, SEGMENT_SEARCH_ACCEPTANCE);
+      MmodControl(MilSearchContext, M_CONTEXT, M_SMOOTHNESS, Params.SegmentSearchSmoothness);
+      MmodControl(MilSearchContext, M_ALL, M_ACCEPTANCE, Params.SegmentSearchAcceptance);
       MmodControl(MilSearchContext, 0, M_NUMBER, MAX_NUMBER_OF_SEGMENTS);
       MmodControl(MilResult, M_GENERAL, M_RESULT_OUTPUT_UNITS, M_WORLD);
       }
@@ -163,13 +244,15 @@ struct SSegmentShapeParamAndResult
 //****************************************************************************
 template <class CModShapeFinder>
 MIL_UNIQUE_MOD_ID SimpleShapeSearch(MIL_ID MilSystem, MIL_ID MilDisplay, MIL_ID MilDepthMap,
-                                    MIL_DOUBLE DefineParam1, MIL_DOUBLE DefineParam2, MIL_INT Iteration)
+                                    MIL_DOUBLE DefineParam1, MIL_DOUBLE DefineParam2, MIL_INT Iteration,
+                                    const SAlignmentParams& Params)
    {
    // Allocate a graphic list to hold the subpixel annotations to draw.
    auto MilGraphicList2d = MgraAllocList(MilSystem, M_DEFAULT, M_UNIQUE_ID);
 
    // Associate the graphic list to the display for annotations.
-   MdispControl(MilDisplay, M_ASSOCIATED_GRAPHIC_LIST_ID, MilGraphicList2d);
+   if(MilDisplay != M_NULL)
+      MdispControl(MilDisplay, M_ASSOCIATED_GRAPHIC_LIST_ID, MilGraphicList2d);
 
    // Allocate a shape finder context.
    auto MilSearchContext = MmodAlloc(MilSystem, CModShapeFinder::ShapeFinderType, M_DEFAULT, M_UNIQUE_ID);
@@ -181,7 +264,7 @@ MIL_UNIQUE_MOD_ID SimpleShapeSearch(MIL_ID MilSystem, MIL_ID MilDisplay, MIL_ID
    MmodDefine(MilSearchContext, CModShapeFinder::ShapeDefineType, DefineParam1, DefineParam2, M_DEFAULT, M_DEFAULT, M_DEFAULT);
 
    // Setup the context and result.
-   CModShapeFinder::SetupShapeContextResult(MilSearchContext, MilResult);
+   CModShapeFinder::SetupShapeContextResult(MilSearchContext, MilResult, Params);
 
    // Preprocess the search context.
    MmodPreprocess(MilSearchContext, M_DEFAULT);
@@ -243,7 +326,7 @@ std::vector<MIL_INT> FindValidSizeXSegmentIndices(const std::vector<MIL_DOUBLE>&
 //****************************************************************************
 // Get the displacement axis according to the edge of the bar.
 //****************************************************************************
-SUnitVector2d GetAxisFromSegments(MIL_ID MilResult, MIL_ID MilDisplay, MIL_INT Iteration)
+SUnitVector2d GetAxisFromSegments(MIL_ID MilResult, MIL_ID MilDisplay, MIL_INT Iteration, MIL_INT* pEdgeIndex = M_NULL)
    {
    // Get the results of the segment search.
    std::vector<MIL_DOUBLE>   EndXPos, EndYPos, CenterXPosition, CenterYPosition;
@@ -283,9 +366,300 @@ SUnitVector2d GetAxisFromSegments(MIL_ID MilResult, MIL_ID MilDisplay, MIL_INT I
       MosGetch();
       }
 
+   if(pEdgeIndex)
+      *pEdgeIndex = MaxIndex;
+
    return {EndXPos[MaxIndex], EndYPos[MaxIndex], CenterXPosition[MaxIndex], CenterYPosition[MaxIndex]};
    }
 
+//****************************************************************************
+// Band of the depth map, in world units, where the shapes are expected, and
+// the best score expected from a search in the band.
+//****************************************************************************
+struct SSearchRegion
+   {
+   bool       IsValid       = false;
+   MIL_DOUBLE MinY          = 0.0;
+   MIL_DOUBLE MaxY          = 0.0;
+   MIL_DOUBLE ExpectedScore = 0.0;
+   };
+
+//****************************************************************************
+// Get the world Y position of a result of a search done in the rows of the
+// depth map starting at OffsetY. The position is read in pixels and converted
+// with the calibration of the depth map it was found in, so that it can be
+// mapped in the depth map of another camera.
+//****************************************************************************
+MIL_DOUBLE GetResultWorldY(MIL_ID MilResult, MIL_INT Index, MIL_INT ResultType, MIL_ID MilDepthMap, MIL_INT OffsetY)
+   {
+   MIL_DOUBLE PixelY, WorldX, WorldY;
+   MmodControl(MilResult, M_GENERAL, M_RESULT_OUTPUT_UNITS, M_PIXEL);
+   MmodGetResult(MilResult, Index, ResultType, &PixelY);
+   MmodControl(MilResult, M_GENERAL, M_RESULT_OUTPUT_UNITS, M_WORLD);
+   McalTransformCoordinate(MilDepthMap, M_PIXEL_TO_WORLD, 0.0, PixelY + OffsetY, &WorldX, &WorldY);
+   return WorldY;
+   }
+
+//****************************************************************************
+// Search regions predicted from the shapes found in the previous camera. The
+// regions are always predicted but only searched when enabled.
+//****************************************************************************
+struct SPredictedSearchRegions
+   {
+   bool          IsEnabled = USE_PREDICTED_SEARCH_REGIONS;
+   SSearchRegion Circle;
+   SSearchRegion Segment;
+
+   // The holes are expected in the band covering all the holes found previously.
+   void UpdateCircleRegion(MIL_ID MilCircleResult, MIL_ID MilDepthMap, MIL_INT SearchOffsetY)
+      {
+      MIL_INT NbResults;
+      MmodGetResult(MilCircleResult, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &NbResults);
+      if(NbResults < 1)
+         return;
+
+      Circle.MinY = std::numeric_limits<MIL_DOUBLE>::max();
+      Circle.MaxY = std::numeric_limits<MIL_DOUBLE>::lowest();
+      for(MIL_INT i = 0; i < NbResults; i++)
+         {
+         MIL_DOUBLE CenterY = GetResultWorldY(MilCircleResult, i, M_POSITION_Y, MilDepthMap, SearchOffsetY);
+         Circle.MinY = std::min(Circle.MinY, CenterY);
+         Circle.MaxY = std::max(Circle.MaxY, CenterY);
+         }
+      Circle.MinY -= HOLE_RADIUS + PREDICTED_REGION_MARGIN_Y;
+      Circle.MaxY += HOLE_RADIUS + PREDICTED_REGION_MARGIN_Y;
+      MmodGetResult(MilCircleResult, 0, M_SCORE, &Circle.ExpectedScore);
+      Circle.IsValid = true;
+      }
+
+   // The edge is expected in the band around the edge found previously.
+   void UpdateSegmentRegion(MIL_ID MilSegmentResult, MIL_INT EdgeIndex, MIL_ID MilDepthMap, MIL_INT SearchOffsetY)
+      {
+      MIL_DOUBLE EdgeCenterY = GetResultWorldY(MilSegmentResult, EdgeIndex, M_CENTER_Y, MilDepthMap, SearchOffsetY);
+      Segment.MinY = EdgeCenterY - PREDICTED_REGION_MARGIN_Y;
+      Segment.MaxY = EdgeCenterY + PREDICTED_REGION_MARGIN_Y;
+      MmodGetResult(MilSegmentResult, 0, M_SCORE, &Segment.ExpectedScore);
+      Segment.IsValid = true;
+      }
+   };
+
+//****************************************************************************
+// Allocate a child of the depth map covering the search region. Returns a
+// null identifier if the region covers the whole depth map.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID AllocSearchRegionChild(MIL_ID MilDepthMap, const SSearchRegion& Region)
+   {
+   MIL_INT SizeX = MbufInquire(MilDepthMap, M_SIZE_X, M_NULL);
+   MIL_INT SizeY = MbufInquire(MilDepthMap, M_SIZE_Y, M_NULL);
+
+   MIL_DOUBLE PixelX, PixelMinY, PixelMaxY;
+   McalTransformCoordinate(MilDepthMap, M_WORLD_TO_PIXEL, 0.0, Region.MinY, &PixelX, &PixelMinY);
+   McalTransformCoordinate(MilDepthMap, M_WORLD_TO_PIXEL, 0.0, Region.MaxY, &PixelX, &PixelMaxY);
+
+   MIL_INT OffsetY = std::max<MIL_INT>(0, (MIL_INT)floor(std::min(PixelMinY, PixelMaxY)));
+   MIL_INT EndY = std::min<MIL_INT>(SizeY, (MIL_INT)ceil(std::max(PixelMinY, PixelMaxY)) + 1);
+   if(EndY - OffsetY <= 0 || EndY - OffsetY >= SizeY)
+      return MIL_UNIQUE_BUF_ID();
+
+   // The child inherits the calibration of the depth map so the results stay in world units.
+   return MbufChild2d(MilDepthMap, 0, OffsetY, SizeX, EndY - OffsetY, M_UNIQUE_ID);
+   }
+
+//****************************************************************************
+// Find shapes in the predicted search region of the depth map. The search is
+// done on the whole depth map if no region is predicted or if the region does
+// not give the minimum number of shapes and the expected score. The first row
+// searched is returned in SearchOffsetY and IsPredicted tells if the search
+// result comes from the region.
+//****************************************************************************
+template <class CModShapeFinder>
+MIL_UNIQUE_MOD_ID PredictedShapeSearch(MIL_ID MilSystem, MIL_ID MilDisplay, MIL_ID MilDepthMap,
+                                       MIL_DOUBLE DefineParam1, MIL_DOUBLE DefineParam2, MIL_INT Iteration,
+                                       const SAlignmentParams& Params, const SSearchRegion& Region,
+                                       MIL_INT& SearchOffsetY, bool& IsPredicted)
+   {
+   if(Region.IsValid)
+      {
+      auto MilSearchChild = AllocSearchRegionChild(MilDepthMap, Region);
+      if(MilSearchChild)
+         {
+         auto MilResult = SimpleShapeSearch<CModShapeFinder>(MilSystem, MilDisplay, MilSearchChild, DefineParam1, DefineParam2, Iteration, Params);
+
+         MIL_INT NumResults;
+         MIL_DOUBLE BestScore = 0.0;
+         MmodGetResult(MilResult, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &NumResults);
+         if(NumResults >= 1)
+            MmodGetResult(MilResult, 0, M_SCORE, &BestScore);
+         if(NumResults >= PREDICTED_REGION_MIN_NB_RESULTS && BestScore >= Region.ExpectedScore - PREDICTED_REGION_SCORE_TOLERANCE)
+            {
+            SearchOffsetY = MbufInquire(MilSearchChild, M_PARENT_OFFSET_Y, M_NULL);
+            IsPredicted = true;
+            return MilResult;
+            }
+         }
+      }
+
+   SearchOffsetY = 0;
+   IsPredicted = false;
+   return SimpleShapeSearch<CModShapeFinder>(MilSystem, MilDisplay, MilDepthMap, DefineParam1, DefineParam2, Iteration, Params);
+   }
+
+//****************************************************************************
+// Results of the hole circle and bar edge segment searches on a depth map.
+//****************************************************************************
+struct SBarFeaturesResult
+   {
+   MIL_UNIQUE_MOD_ID MilCircleResult;
+   MIL_UNIQUE_MOD_ID MilSegmentResult;
+   MIL_INT    CircleSearchOffsetY  = 0; // First row of the depth map searched.
+   MIL_INT    SegmentSearchOffsetY = 0;
+   bool       IsCircleSearchPredicted  = false; // Result found in the predicted region.
+   bool       IsSegmentSearchPredicted = false;
+   MIL_INT    NbCircles  = 0;
+   MIL_INT    NbSegments = 0;
+   MIL_DOUBLE CircleXPos = 0.0; // Position of the best circle.
+   MIL_DOUBLE CircleYPos = 0.0;
+   };
+
+//****************************************************************************
+// Find the hole circles and the bar edge segments on a depth map. The circle
+// and segment finders are distinct contexts that each extract the edges of the
+// depth map, so they run concurrently except for the first iteration, where
+// their results are printed and drawn one after the other.
+//****************************************************************************
+SBarFeaturesResult FindBarFeatures(MIL_ID MilSystem, MIL_ID MilDisplay, MIL_ID MilDepthMap, MIL_INT Iteration,
+                                   const SAlignmentParams& Params, const SPredictedSearchRegions& SearchRegions)
+   {
+   SBarFeaturesResult Features;
+   const SSearchRegion NoRegion;
+   const SSearchRegion& CircleRegion  = SearchRegions.IsEnabled ? SearchRegions.Circle : NoRegion;
+   const SSearchRegion& SegmentRegion = SearchRegions.IsEnabled ? SearchRegions.Segment : NoRegion;
+   auto CircleSearch = [&](MIL_ID MilSearchDisplay)
+      {
+      Features.MilCircleResult = PredictedShapeSearch<SCircleShapeParamAndResult>(MilSystem, MilSearchDisplay, MilDepthMap, M_DEFAULT, HOLE_RADIUS,
+                                                                                 Iteration, Params, CircleRegion,
+                                                                                 Features.CircleSearchOffsetY, Features.IsCircleSearchPredicted);
+      };
+   auto SegmentSearch = [&](MIL_ID MilSearchDisplay)
+      {
+      Features.MilSegmentResult = PredictedShapeSearch<SSegmentShapeParamAndResult>(MilSystem, MilSearchDisplay, MilDepthMap, SEGMENT_LENGTH, M_DEFAULT,
+                                                                                    Iteration, Params, SegmentRegion,
+                                                                                    Features.SegmentSearchOffsetY, Features.IsSegmentSearchPredicted);
+      };
+
+   if(Iteration == 0)
+      {
+      CircleSearch(MilDisplay);
+      SegmentSearch(MilDisplay);
+      }
+   else
+      {
+      ParallelForEachTask(2, 2, [&](MIL_INT Task, MIL_INT)
+         {
+         if(Task == 0)
+            CircleSearch(M_NULL);
+         else
+            SegmentSearch(M_NULL);
+         });
+      }
+
+   MmodGetResult(Features.MilCircleResult, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &Features.NbCircles);
+   MmodGetResult(Features.MilSegmentResult, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &Features.NbSegments);
+   if(Features.NbCircles > 0)
+      {
+      MmodGetResult(Features.MilCircleResult, 0, M_POSITION_X, &Features.CircleXPos);
+      MmodGetResult(Features.MilCircleResult, 0, M_POSITION_Y, &Features.CircleYPos);
+      }
+
+   return Features;
+   }
+
+//****************************************************************************
+// Time of the bar feature searches on the whole depth map and in the predicted
+// regions, and which of the predicted searches were kept.
+//****************************************************************************
+struct SPredictedSearchTiming
+   {
+   MIL_INT    CameraIndex              = 0;
+   MIL_DOUBLE FullTime                 = 0.0;
+   MIL_DOUBLE PredictedTime            = 0.0;
+   bool       IsCircleSearchPredicted  = false;
+   bool       IsSegmentSearchPredicted = false;
+   };
+
+//****************************************************************************
+// Time the bar feature searches on a depth map with and without the regions
+// predicted from the previous camera. The best time of a few repetitions is
+// kept for each path.
+//****************************************************************************
+SPredictedSearchTiming TimePredictedSearch(MIL_ID MilSystem, MIL_ID MilDepthMap, const SAlignmentParams& Params,
+                                           const SPredictedSearchRegions& SearchRegions, MIL_INT CameraIndex)
+   {
+   SPredictedSearchTiming Timing;
+   Timing.CameraIndex = CameraIndex;
+
+   auto TimeSearch = [&](bool IsEnabled)
+      {
+      SPredictedSearchRegions Regions = SearchRegions;
+      Regions.IsEnabled = IsEnabled;
+      MIL_DOUBLE BestTime = -1.0;
+      for(MIL_INT Rep = 0; Rep < PREDICTED_SEARCH_NB_REPETITIONS; Rep++)
+         {
+         MIL_DOUBLE StartTime, EndTime;
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &StartTime);
+         auto Features = FindBarFeatures(MilSystem, M_NULL, MilDepthMap, SILENT_ITERATION, Params, Regions);
+         MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &EndTime);
+         if(BestTime < 0.0 || EndTime - StartTime < BestTime)
+            BestTime = EndTime - StartTime;
+         Timing.IsCircleSearchPredicted = Features.IsCircleSearchPredicted;
+         Timing.IsSegmentSearchPredicted = Features.IsSegmentSearchPredicted;
+         }
+      return BestTime;
+      };
+
+   Timing.FullTime = TimeSearch(false);
+   Timing.PredictedTime = TimeSearch(true);
+   return Timing;
+   }
+
+//****************************************************************************
+// Print the search timings of the cameras and the overall speedup of the
+// predicted regions. A fallback to the whole depth map is reported as "full".
+//****************************************************************************
+void PrintPredictedSearchTimings(const std::vector<SPredictedSearchTiming>& Timings)
+   {
+   if(Timings.empty())
+      return;
+
+   MosPrintf(MIL_TEXT("\nBar feature search in the predicted regions.\n\n"));
+   MosPrintf(MIL_TEXT("|-------------|---------|---------|---------|---------|---------|\n"));
+   MosPrintf(MIL_TEXT("| Altiz Index | Full(ms)| Pred(ms)| Speedup | Circles | Segments|\n"));
+   MosPrintf(MIL_TEXT("|-------------|---------|---------|---------|---------|---------|\n"));
+
+   MIL_DOUBLE TotalFullTime = 0.0;
+   MIL_DOUBLE TotalPredictedTime = 0.0;
+   MIL_INT NbFallbacks = 0;
+   for(const auto& Timing : Timings)
+      {
+      MosPrintf(MIL_TEXT("|%13d|%9.1f|%9.1f|%9.2f|%9s|%9s|\n"), (int)Timing.CameraIndex,
+                Timing.FullTime * 1000.0, Timing.PredictedTime * 1000.0, Timing.FullTime / Timing.PredictedTime,
+                Timing.IsCircleSearchPredicted ? MIL_TEXT("band") : MIL_TEXT("full"),
+                Timing.IsSegmentSearchPredicted ? MIL_TEXT("band") : MIL_TEXT("full"));
+      TotalFullTime += Timing.FullTime;
+      TotalPredictedTime += Timing.PredictedTime;
+      NbFallbacks += (Timing.IsCircleSearchPredicted ? 0 : 1) + (Timing.IsSegmentSearchPredicted ? 0 : 1);
+      }
+   MosPrintf(MIL_TEXT("|-------------|---------|---------|---------|---------|---------|\n"));
+   MosPrintf(MIL_TEXT("|        Total|%9.1f|%9.1f|%9.2f|         |         |\n\n"),
+             TotalFullTime * 1000.0, TotalPredictedTime * 1000.0, TotalFullTime / TotalPredictedTime);
+
+   MosPrintf(MIL_TEXT("%d of the %d searches fell back to the whole depth map.\n"), (int)NbFallbacks, (int)(2 * Timings.size()));
+   if(TotalPredictedTime < TotalFullTime)
+      MosPrintf(MIL_TEXT("The predicted regions are faster on these scans; USE_PREDICTED_SEARCH_REGIONS can be enabled.\n\n"));
+   else
+      MosPrintf(MIL_TEXT("The predicted regions are not faster on these scans; keep USE_PREDICTED_SEARCH_REGIONS disabled.\n\n"));
+   }
+
 //****************************************************************************
 // Get alignement matrix relative to first camera.
 //****************************************************************************
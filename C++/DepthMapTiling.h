@@ -0,0 +1,212 @@
+﻿//***************************************************************************************/
+// 
+// File name: DepthMapTiling.h
+//
+// Synopsis: Implementation of the tiled projection of a point cloud in a depth map. The
+//           rows of the depth map are split in tiles with a halo large enough for the
+//           gap filling; the points of each tile are gathered from row bands of the
+//           point cloud, then the tiles are projected and gap filled in parallel. The
+//           result is meant to be identical to the projection and gap filling of the
+//           whole image, which the benchmark of the depth map creation verifies.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+
+// The depth maps are created in a single pass unless the tiled creation is enabled.
+static const bool    USE_TILED_DEPTH_MAP            = false;
+
+static const MIL_INT DEPTH_MAP_MIN_TILE_SIZE_Y      = 32;    // Minimum number of rows of a tile.
+static const MIL_INT DEPTH_MAP_NB_TILES_PER_WORKER  = 4;
+static const MIL_INT DEPTH_MAP_BAND_NB_ROWS         = 64;    // Rows of the point cloud per gathering band.
+static const MIL_INT DEPTH_MAP_TILE_CLOUD_SIZE_X    = 4096;  // Row size of the point lists of the tiles.
+
+//****************************************************************************
+// Tile of the depth map: core rows [CoreY, CoreY + CoreSizeY) and halo rows
+// [HaloY, HaloY + HaloSizeY).
+//****************************************************************************
+struct SDepthMapTile
+   {
+   MIL_INT CoreY;
+   MIL_INT CoreSizeY;
+   MIL_INT HaloY;
+   MIL_INT HaloSizeY;
+   MIL_INT NbPoints = 0;
+   MIL_UNIQUE_BUF_ID MilPointList;
+   SPointCloudAccess Access;
+   };
+
+//****************************************************************************
+// Allocate the context to fill the gaps of a depth map, with the thresholds in
+// pixels.
+//****************************************************************************
+MIL_UNIQUE_3DIM_ID AllocFillGapsContext(MIL_ID MilSystem, MIL_INT FillGapsThresholdPixel)
+   {
+   auto MilFillGapsContext = M3dimAlloc(MilSystem, M_FILL_GAPS_CONTEXT, M_DEFAULT, M_UNIQUE_ID);
+   M3dimControl(MilFillGapsContext, M_FILL_THRESHOLD_X, FillGapsThresholdPixel);
+   M3dimControl(MilFillGapsContext, M_FILL_THRESHOLD_Y, FillGapsThresholdPixel);
+   M3dimControl(MilFillGapsContext, M_INPUT_UNITS, M_PIXEL);
+   return MilFillGapsContext;
+   }
+
+//****************************************************************************
+// Allocate an unorganized list of points for the projection of a tile. The
+// points are laid out in rows; the unused points have a null confidence.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID AllocDepthMapTilePoints(MIL_ID MilSystem, MIL_INT NbPoints)
+   {
+   MIL_INT SizeX = std::max<MIL_INT>(1, std::min(NbPoints, DEPTH_MAP_TILE_CLOUD_SIZE_X));
+   MIL_INT SizeY = std::max<MIL_INT>(1, (NbPoints + SizeX - 1) / SizeX);
+   auto MilPointList = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   MbufAllocComponent(MilPointList, 3, SizeX, SizeY, 32 + M_FLOAT, M_IMAGE + M_PROC + M_PLANAR, M_COMPONENT_RANGE, M_NULL);
+   MIL_ID MilConfidence = MbufAllocComponent(MilPointList, 1, SizeX, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PROC, M_COMPONENT_CONFIDENCE, M_NULL);
+   MbufClear(MilConfidence, 0);
+   MbufControlContainer(MilPointList, M_COMPONENT_RANGE, M_3D_REPRESENTATION, M_CALIBRATED_XYZ_UNORGANIZED);
+   return MilPointList;
+   }
+
+//****************************************************************************
+// Project a point cloud in a calibrated depth map and fill its gaps, by tiles
+// processed in parallel. Returns false if the point cloud can't be accessed,
+// in which case the depth map is left untouched.
+//
+// The tiles alternate between the depth map and a scratch depth map with the
+// same calibration, so that the halos of the tiles processed concurrently in
+// the same buffer never overlap. The core rows of the tiles of the scratch
+// depth map are copied at the end. Each tile receives the points of its halo
+// in their original order, so the projection and the gap filling of its core
+// rows are the same as for the whole image.
+//
+// The MIL multiprocessing is disabled in the threads that process the tiles,
+// since the tiles already keep all the cores busy.
+//****************************************************************************
+bool ProjectAndFillGapsTiled(MIL_ID MilSystem, MIL_ID MilPointCloud, MIL_ID MilDepthMap, MIL_ID MilScratchDepthMap,
+                             MIL_INT FillGapsThresholdPixel, MIL_INT NbWorkers)
+   {
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return false;
+
+   // Split the depth map in tiles. The halo covers the gaps that can be filled,
+   // plus two rows: one for the rounding of the point positions and one for the
+   // border of the gaps.
+   const MIL_INT SizeX = MbufInquire(MilDepthMap, M_SIZE_X, M_NULL);
+   const MIL_INT SizeY = MbufInquire(MilDepthMap, M_SIZE_Y, M_NULL);
+   const MIL_INT Halo = FillGapsThresholdPixel + 2;
+   const MIL_INT TileSizeY = std::max({DEPTH_MAP_MIN_TILE_SIZE_Y, 2 * Halo, (SizeY + DEPTH_MAP_NB_TILES_PER_WORKER * NbWorkers - 1) / (DEPTH_MAP_NB_TILES_PER_WORKER * NbWorkers)});
+   const MIL_INT NbTiles = (SizeY + TileSizeY - 1) / TileSizeY;
+   std::vector<SDepthMapTile> Tiles(NbTiles);
+   for(MIL_INT t = 0; t < NbTiles; t++)
+      {
+      auto& Tile = Tiles[t];
+      Tile.CoreY = t * TileSizeY;
+      Tile.CoreSizeY = std::min(TileSizeY, SizeY - Tile.CoreY);
+      Tile.HaloY = std::max<MIL_INT>(0, Tile.CoreY - Halo);
+      Tile.HaloSizeY = std::min(SizeY, Tile.CoreY + Tile.CoreSizeY + Halo) - Tile.HaloY;
+      }
+
+   // The depth map rows are linear in Y in the world.
+   MIL_DOUBLE PixelX, PixelY0, PixelY1;
+   McalTransformCoordinate(MilDepthMap, M_WORLD_TO_PIXEL, 0.0, 0.0, &PixelX, &PixelY0);
+   McalTransformCoordinate(MilDepthMap, M_WORLD_TO_PIXEL, 0.0, 1.0, &PixelX, &PixelY1);
+   const MIL_DOUBLE RowScale = PixelY1 - PixelY0;
+   auto ForEachTileOfPoint = [&](MIL_FLOAT WorldY, auto Func)
+      {
+      MIL_INT Row = static_cast<MIL_INT>(floor(PixelY0 + RowScale * WorldY + 0.5));
+      if(Row < -1 || Row > SizeY)
+         return;
+      MIL_INT FirstTile = std::max<MIL_INT>(0, (Row - Halo) / TileSizeY - 1);
+      MIL_INT LastTile = std::min<MIL_INT>(NbTiles - 1, (Row + Halo) / TileSizeY);
+      for(MIL_INT t = FirstTile; t <= LastTile; t++)
+         {
+         if(Row >= Tiles[t].HaloY - 1 && Row <= Tiles[t].HaloY + Tiles[t].HaloSizeY)
+            Func(t);
+         }
+      };
+
+   // Count the points of each tile in each row band of the point cloud.
+   const MIL_INT NbBands = (Access.SizeY + DEPTH_MAP_BAND_NB_ROWS - 1) / DEPTH_MAP_BAND_NB_ROWS;
+   std::vector<MIL_INT> BandCounts(NbBands * NbTiles, 0);
+   auto ForEachBandPoint = [&](MIL_INT Band, auto Func)
+      {
+      MIL_INT Begin = Band * DEPTH_MAP_BAND_NB_ROWS * Access.SizeX;
+      MIL_INT End = std::min(Access.SizeY, (Band + 1) * DEPTH_MAP_BAND_NB_ROWS) * Access.SizeX;
+      ForEachValidRun(Access, Begin, End, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+         {
+         for(MIL_INT i = Y * Access.RangePitch + X; i < Y * Access.RangePitch + X + Count; i++)
+            Func(i);
+         });
+      };
+   ParallelForEachTask(NbBands, NbWorkers, [&](MIL_INT Band, MIL_INT)
+      {
+      ForEachBandPoint(Band, [&](MIL_INT i)
+         {
+         ForEachTileOfPoint(Access.Range[1][i], [&](MIL_INT t) { BandCounts[Band * NbTiles + t]++; });
+         });
+      });
+
+   // Place the points of the bands in the tiles, in the order of the point cloud.
+   std::vector<MIL_INT> BandOffsets(NbBands * NbTiles);
+   for(MIL_INT t = 0; t < NbTiles; t++)
+      {
+      for(MIL_INT Band = 0; Band < NbBands; Band++)
+         {
+         BandOffsets[Band * NbTiles + t] = Tiles[t].NbPoints;
+         Tiles[t].NbPoints += BandCounts[Band * NbTiles + t];
+         }
+      Tiles[t].MilPointList = AllocDepthMapTilePoints(MilSystem, Tiles[t].NbPoints);
+      Tiles[t].Access = AccessPointCloud(Tiles[t].MilPointList);
+      }
+
+   ParallelForEachTask(NbBands, NbWorkers, [&](MIL_INT Band, MIL_INT)
+      {
+      ForEachBandPoint(Band, [&](MIL_INT i)
+         {
+         ForEachTileOfPoint(Access.Range[1][i], [&](MIL_INT t)
+            {
+            auto& TileAccess = Tiles[t].Access;
+            MIL_INT Dst = BandOffsets[Band * NbTiles + t]++;
+            MIL_INT DstX = Dst % TileAccess.SizeX;
+            MIL_INT DstY = Dst / TileAccess.SizeX;
+            for(MIL_INT b = 0; b < 3; b++)
+               TileAccess.Range[b][DstY * TileAccess.RangePitch + DstX] = Access.Range[b][i];
+            TileAccess.Confidence[DstY * TileAccess.ConfidencePitch + DstX] = 255;
+            });
+         });
+      });
+
+   // Project and fill the gaps of the tiles. The even tiles are processed in the
+   // depth map and the odd tiles in the scratch depth map.
+   std::vector<MIL_UNIQUE_3DIM_ID> MilFillGapsContexts;
+   for(MIL_INT w = 0; w < NbWorkers; w++)
+      MilFillGapsContexts.push_back(AllocFillGapsContext(MilSystem, FillGapsThresholdPixel));
+
+   // The calling thread is one of the workers; its multiprocessing setting is restored after.
+   MIL_INT CallerMpUse;
+   MappInquireMp(M_DEFAULT, M_MP_USE, M_DEFAULT, M_DEFAULT, &CallerMpUse);
+   ParallelForEachTask(NbTiles, NbWorkers, [&](MIL_INT t, MIL_INT Worker)
+      {
+      MappControlMp(M_DEFAULT, M_MP_USE, M_DEFAULT, M_DISABLE, M_NULL);
+      const auto& Tile = Tiles[t];
+      MIL_ID MilTarget = (t % 2 == 0) ? MilDepthMap : MilScratchDepthMap;
+      auto MilTileChild = MbufChild2d(MilTarget, 0, Tile.HaloY, SizeX, Tile.HaloSizeY, M_UNIQUE_ID);
+      M3dimProject(Tile.MilPointList, MilTileChild, M_NULL, M_POINT_BASED, M_DEFAULT, M_DEFAULT, M_DEFAULT);
+      M3dimFillGaps(MilFillGapsContexts[Worker], MilTileChild, M_NULL, M_DEFAULT);
+      });
+
+   MappControlMp(M_DEFAULT, M_MP_USE, M_DEFAULT, CallerMpUse, M_NULL);
+
+   // Copy the core rows of the odd tiles in the depth map.
+   for(MIL_INT t = 1; t < NbTiles; t += 2)
+      {
+      auto MilSrcChild = MbufChild2d(MilScratchDepthMap, 0, Tiles[t].CoreY, SizeX, Tiles[t].CoreSizeY, M_UNIQUE_ID);
+      auto MilDstChild = MbufChild2d(MilDepthMap, 0, Tiles[t].CoreY, SizeX, Tiles[t].CoreSizeY, M_UNIQUE_ID);
+      MbufCopy(MilSrcChild, MilDstChild);
+      }
+
+   return true;
+   }
@@ -0,0 +1,217 @@
+﻿//***************************************************************************************/
+// 
+// File name: DisplayFeed.h
+//
+// Synopsis: Implementation of the level-of-detail display feed of the point clouds. The
+//           points are spatially decimated to a fixed budget and shown in a persistent
+//           3D display, through two display buffers updated by a display thread, so the
+//           rendering cost doesn't depend on the scan size and never blocks the merge.
+//           The display thread allocates the 3D display and is the only one to use it.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+static const MIL_INT DISPLAY_LOD_NB_POINTS = 250000;  // Budget of displayed points.
+static const MIL_INT DISPLAY_LOD_SIZE_X    = 1024;    // Row size of the display buffers.
+static const MIL_INT DISPLAY_LOD_CAPACITY  = 2 * DISPLAY_LOD_NB_POINTS;
+
+//****************************************************************************
+// Allocate a buffer of the level-of-detail points.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID AllocLodPointCloud(MIL_ID MilSystem, MIL_INT Capacity = DISPLAY_LOD_CAPACITY)
+   {
+   MIL_INT SizeY = (Capacity + DISPLAY_LOD_SIZE_X - 1) / DISPLAY_LOD_SIZE_X;
+   auto MilLodPointCloud = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   MbufAllocComponent(MilLodPointCloud, 3, DISPLAY_LOD_SIZE_X, SizeY, 32 + M_FLOAT, M_IMAGE + M_PROC + M_PLANAR, M_COMPONENT_RANGE, M_NULL);
+   MbufAllocComponent(MilLodPointCloud, 3, DISPLAY_LOD_SIZE_X, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PROC + M_PLANAR, M_COMPONENT_REFLECTANCE, M_NULL);
+   MbufAllocComponent(MilLodPointCloud, 1, DISPLAY_LOD_SIZE_X, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PROC, M_COMPONENT_CONFIDENCE, M_NULL);
+   MbufControlContainer(MilLodPointCloud, M_COMPONENT_RANGE, M_3D_REPRESENTATION, M_CALIBRATED_XYZ_UNORGANIZED);
+   return MilLodPointCloud;
+   }
+
+//****************************************************************************
+// Fill the level-of-detail points of a point cloud. The XY plane of the
+// bounding box is split in about NbPointsBudget cells and the first valid
+// point of each cell is kept. Returns the number of kept points and, if
+// pBox is given, the bounding box of the valid points.
+//****************************************************************************
+MIL_INT FillLodPointCloud(const SPointCloudAccess& Src, SPointCloudAccess& Dst, SValidPointsBox* pBox = nullptr,
+                          MIL_INT NbPointsBudget = DISPLAY_LOD_NB_POINTS)
+   {
+   for(MIL_INT y = 0; y < Dst.SizeY; y++)
+      memset(Dst.Confidence + y * Dst.ConfidencePitch, 0, Dst.SizeX);
+
+   auto Box = GetValidPointsBox(Src, 0, Src.NbPoints());
+   if(pBox)
+      *pBox = Box;
+   if(Box.NbPoints == 0)
+      return 0;
+
+   MIL_DOUBLE SizeX = std::max<MIL_DOUBLE>(Box.Max[0] - Box.Min[0], 1.0e-6);
+   MIL_DOUBLE SizeY = std::max<MIL_DOUBLE>(Box.Max[1] - Box.Min[1], 1.0e-6);
+   MIL_DOUBLE CellSize = sqrt(SizeX * SizeY / NbPointsBudget);
+   MIL_INT NbCellsX = static_cast<MIL_INT>(SizeX / CellSize) + 1;
+   MIL_INT NbCellsY = static_cast<MIL_INT>(SizeY / CellSize) + 1;
+   std::vector<MIL_UINT8> IsCellUsed(NbCellsX * NbCellsY, 0);
+
+   const MIL_INT Capacity = Dst.NbPoints();
+   MIL_INT NbLodPoints = 0;
+   ForEachValidRun(Src, 0, Src.NbPoints(), [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+      {
+      const MIL_INT RangeIdx = Y * Src.RangePitch + X;
+      for(MIL_INT p = 0; p < Count && NbLodPoints < Capacity; p++)
+         {
+         MIL_INT CellX = static_cast<MIL_INT>((Src.Range[0][RangeIdx + p] - Box.Min[0]) / CellSize);
+         MIL_INT CellY = static_cast<MIL_INT>((Src.Range[1][RangeIdx + p] - Box.Min[1]) / CellSize);
+         auto& IsUsed = IsCellUsed[CellY * NbCellsX + CellX];
+         if(IsUsed)
+            continue;
+         IsUsed = 1;
+
+         MIL_INT DstX = NbLodPoints % Dst.SizeX;
+         MIL_INT DstY = NbLodPoints / Dst.SizeX;
+         for(MIL_INT b = 0; b < 3; b++)
+            {
+            Dst.Range[b][DstY * Dst.RangePitch + DstX] = Src.Range[b][RangeIdx + p];
+            Dst.Color[b][DstY * Dst.ColorPitch + DstX] = Src.HasColor() ? Src.Color[b][Y * Src.ColorPitch + X + p] : 255;
+            }
+         Dst.Confidence[DstY * Dst.ConfidencePitch + DstX] = 255;
+         NbLodPoints++;
+         }
+      });
+
+   return NbLodPoints;
+   }
+
+//****************************************************************************
+// Level-of-detail display feed. The processing thread submits its point
+// clouds; only the latest one is shown when the display thread is busy. The
+// 3D display is allocated by the display thread, with the given function,
+// and freed when the display thread ends.
+//****************************************************************************
+class CDisplayFeed
+   {
+   public:
+      CDisplayFeed(MIL_ID MilSystem, std::function<MIL_UNIQUE_3DDISP_ID()> AllocDisplay)
+         {
+         for(auto& MilBuffer : m_MilBuffers)
+            MilBuffer = AllocLodPointCloud(MilSystem);
+         m_Thread = std::thread(&CDisplayFeed::Run, this, std::move(AllocDisplay));
+
+         // Wait for the allocation of the display.
+         std::unique_lock<std::mutex> Lock(m_Mutex);
+         m_Started.wait(Lock, [&]() { return m_IsStarted; });
+         }
+
+      ~CDisplayFeed()
+         {
+         {
+         std::lock_guard<std::mutex> Lock(m_Mutex);
+         m_Stop = true;
+         }
+         m_Submitted.notify_one();
+         if(m_Thread.joinable())
+            m_Thread.join();
+         }
+
+      bool IsValid() const { return m_IsValid; }
+      MIL_INT GetNbDisplayed() const { return m_NbDisplayed; }
+      MIL_INT GetNbSkipped() const { return m_NbSkipped; }
+
+      // Give a point cloud to the display thread. Returns without waiting.
+      void Submit(MIL_UNIQUE_BUF_ID&& MilPointCloud)
+         {
+         if(!IsValid())
+            return;
+         {
+         std::lock_guard<std::mutex> Lock(m_Mutex);
+         if(m_MilPending != M_NULL)
+            m_NbSkipped++;
+         m_MilPending = std::move(MilPointCloud);
+         }
+         m_Submitted.notify_one();
+         }
+
+   private:
+      void Run(std::function<MIL_UNIQUE_3DDISP_ID()> AllocDisplay);
+
+      std::array<MIL_UNIQUE_BUF_ID, 2> m_MilBuffers;
+      MIL_INT                          m_BackBuffer = 0;
+      bool                             m_IsViewSet = false;
+      SValidPointsBox                  m_ViewBox; // Bounding box framed by the view.
+
+      std::thread             m_Thread;
+      std::mutex              m_Mutex;
+      std::condition_variable m_Started;
+      std::condition_variable m_Submitted;
+      bool                    m_IsStarted = false;
+      bool                    m_IsValid = false;
+      MIL_UNIQUE_BUF_ID       m_MilPending;
+      bool                    m_Stop = false;
+      std::atomic<MIL_INT>    m_NbDisplayed{0};
+      std::atomic<MIL_INT>    m_NbSkipped{0};
+   };
+
+//****************************************************************************
+// Display thread. The level of detail of the latest point cloud is built in
+// the back buffer, which is then selected in the display. The view is framed
+// again whenever the bounding box of the points changes.
+//****************************************************************************
+void CDisplayFeed::Run(std::function<MIL_UNIQUE_3DDISP_ID()> AllocDisplay)
+   {
+   auto MilDisplay3d = AllocDisplay();
+   {
+   std::lock_guard<std::mutex> Lock(m_Mutex);
+   m_IsStarted = true;
+   m_IsValid = MilDisplay3d != M_NULL;
+   }
+   m_Started.notify_one();
+   if(!MilDisplay3d)
+      return;
+
+   while(true)
+      {
+      MIL_UNIQUE_BUF_ID MilPointCloud;
+      {
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+      m_Submitted.wait(Lock, [&]() { return m_Stop || m_MilPending != M_NULL; });
+      if(m_Stop)
+         return;
+      MilPointCloud = std::move(m_MilPending);
+      }
+
+      // The level of detail is built from a floating-point range.
+      if(MbufInquireContainer(MilPointCloud, M_COMPONENT_RANGE, M_TYPE, M_NULL) != 32 + M_FLOAT)
+         MbufConvert3d(MilPointCloud, MilPointCloud, M_NULL, M_DEFAULT, M_DEFAULT);
+
+      auto Src = AccessPointCloud(MilPointCloud);
+      auto Dst = AccessPointCloud(m_MilBuffers[m_BackBuffer]);
+      if(!Src.IsValid || !Dst.IsValid)
+         continue;
+      SValidPointsBox Box;
+      FillLodPointCloud(Src, Dst, &Box);
+
+      M3ddispControl(MilDisplay3d, M_UPDATE, M_DISABLE);
+      M3ddispSelect(MilDisplay3d, m_MilBuffers[m_BackBuffer], M_SELECT, M_DEFAULT);
+      bool IsBoxChanged = Box.NbPoints > 0 && (!m_IsViewSet ||
+                          !std::equal(Box.Min, Box.Min + 3, m_ViewBox.Min) || !std::equal(Box.Max, Box.Max + 3, m_ViewBox.Max));
+      if(IsBoxChanged)
+         {
+         M3ddispSetView(MilDisplay3d, M_AUTO, M_BOTTOM_TILTED, M_DEFAULT, M_DEFAULT, M_DEFAULT);
+         M3ddispSetView(MilDisplay3d, M_FLIP, M_AXIS_Y, M_DEFAULT, M_DEFAULT, M_DEFAULT);
+         m_ViewBox = Box;
+         m_IsViewSet = true;
+         }
+      M3ddispControl(MilDisplay3d, M_UPDATE, M_ENABLE);
+
+      m_BackBuffer = 1 - m_BackBuffer;
+      m_NbDisplayed++;
+      }
+   }
@@ -19,7 +19,6 @@ static const MIL_DOUBLE BAR_DIM_TOLERANCE      = 60.0;
 static const MIL_DOUBLE PLANE_RECT_OPACITY = 80.0;
 
 static const MIL_DOUBLE PLANE_DATA_CROP_BOX_DEPTH = 0.5;
-static const MIL_DOUBLE PLANE_DATA_CROP_BOX_SCALE = 2.0;
 
 //******************************************************************************
 // Utility structures.
@@ -44,7 +43,8 @@ struct SFindBarPlaneResult
 //****************************************************************************
 // Use 3D rectangle finder and line fit to get Ry and Tz.
 //****************************************************************************
-SFindBarPlaneResult FindRotationYAndTranslationZ(MIL_ID MilSystem, MIL_ID MilPointCloud, MIL_ID MilGraphicList, MIL_INT Iteration)
+SFindBarPlaneResult FindRotationYAndTranslationZ(MIL_ID MilSystem, MIL_ID MilPointCloud, MIL_ID MilGraphicList, MIL_INT Iteration,
+                                                 const SAlignmentParams& Params)
    {
    SFindBarPlaneResult FindResult;
 
@@ -89,7 +89,7 @@ SFindBarPlaneResult FindRotationYAndTranslationZ(MIL_ID MilSystem, MIL_ID MilPoi
       auto MilBox = M3dgeoAlloc(MilSystem, M_GEOMETRY, M_DEFAULT, M_UNIQUE_ID);
       M3dmodCopyResult(MilModResult, 0, MilBox, M_DEFAULT, M_BOUNDING_BOX, M_DEFAULT);
       M3dgeoBox(MilBox, M_CENTER_AND_DIMENSION + M_ORIENTATION_UNCHANGED, M_UNCHANGED, M_UNCHANGED, M_UNCHANGED, M_UNCHANGED, M_UNCHANGED, PLANE_DATA_CROP_BOX_DEPTH, M_DEFAULT);
-      M3dimScale(MilBox, MilBox, PLANE_DATA_CROP_BOX_SCALE, PLANE_DATA_CROP_BOX_SCALE, PLANE_DATA_CROP_BOX_SCALE, M_GEOMETRY_CENTER, M_DEFAULT, M_DEFAULT, M_DEFAULT);
+      M3dimScale(MilBox, MilBox, Params.PlaneDataCropBoxScale, Params.PlaneDataCropBoxScale, Params.PlaneDataCropBoxScale, M_GEOMETRY_CENTER, M_DEFAULT, M_DEFAULT, M_DEFAULT);
       M3dimCrop(MilPointCloud, FindResult.MilTransformedPointCloud, MilBox, M_NULL, M_SAME, M_DEFAULT);
 
       // Project the point on the Y = 0 plane.
@@ -125,8 +125,20 @@ SFindBarPlaneResult FindRotationYAndTranslationZ(MIL_ID MilSystem, MIL_ID MilPoi
       FindResult.Transformation = {0.0, 0.0, -LineCenterZ, 0.0, RotAngle, 0.0};
       FindResult.IsValid = true;
       }
-   else
+   else if(Iteration != SILENT_ITERATION)
       MosPrintf(MIL_TEXT("The bar plane was not found.\n"));
 
    return FindResult;
    }
+
+//****************************************************************************
+// Compose the rotation Y and translation Z of the bar plane with the
+// translation found from the holes and the displacement axis.
+//****************************************************************************
+void ComposeBarPlaneTransform(MIL_ID MilTransformMatrix, const STransformation& BarPlaneTransformation)
+   {
+   MIL_DOUBLE Tx, Ty, Tz;
+   M3dgeoMatrixGetTransform(MilTransformMatrix, M_TRANSLATION, &Tx, &Ty, &Tz, M_NULL, M_DEFAULT);
+   M3dgeoMatrixSetTransform(MilTransformMatrix, M_ROTATION_Y, BarPlaneTransformation.RY, M_DEFAULT, M_DEFAULT, M_DEFAULT, M_ASSIGN);
+   M3dgeoMatrixSetTransform(MilTransformMatrix, M_TRANSLATION, Tx, Ty, BarPlaneTransformation.TZ + Tz, M_DEFAULT, M_COMPOSE_WITH_CURRENT);
+   }
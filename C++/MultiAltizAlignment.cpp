@@ -15,8 +15,20 @@
 //*************************************************************************************/
 #include <mil.h>
 #include <array>
+#include "ParallelTasks.h"
+#include "ValidityIndex.h"
+#include "PointCloudAccess.h"
+#include "AlignmentParams.h"
+#include "PointCloudExport.h"
+#include "DepthMapTiling.h"
 #include "AutomaticAlignment.h"
 #include "FindRotationYAndTranslationZ.h"
+#include "AlignmentTuner.h"
+#include "TiledMerge.h"
+#include "ValidPointsMerge.h"
+#include "ReplaySource.h"
+#include "QuantizedRange.h"
+#include "DisplayFeed.h"
 
 //***************************************************************************
 // Example description.
@@ -91,8 +103,32 @@ static const MIL_DOUBLE DISP_DEPTH_MAP_ZOOM = 0.6;
 // Bar with holes information.
 static const MIL_INT BAR_HOLES_DISTANCE_X = 100;
 
-// Point cloud merge.
-static const MIL_INT MERGE_DECIMATION_STEP = 4;
+// Parameter tuning.
+static const bool RUN_PARAMETER_TUNING = false;
+
+// Point cloud export.
+static const bool          EXPORT_MERGED_POINT_CLOUD   = true;
+static const bool          EXPORT_ALIGNED_POINT_CLOUDS = false;
+static const EExportFormat EXPORT_FORMAT               = EExportFormat::eTiledCompressed;
+static const MIL_STRING    FILE_EXPORT_BAR             = MIL_TEXT("AlignedBar");
+static const MIL_STRING    FILE_EXPORT_KEYBOARD        = MIL_TEXT("AlignedKeyboard");
+
+// Out-of-core merge in tiles along Y, for scans that don't fit in memory.
+static const bool USE_OUT_OF_CORE_MERGE = false;
+
+// Transform and merge in a 16-bit quantized representation of the range.
+static const bool USE_QUANTIZED_MERGE = false;
+static const bool CHECK_QUANTIZED_TRANSFORM = true;   // Compare with M3dimMatrixTransform.
+
+// Line rate benchmark with virtual cameras replaying the scans.
+static const bool RUN_REPLAY_BENCHMARK        = false;
+static const bool REPLAY_USE_GENERATED_SCANS  = false;
+
+// Scaling of the tiled depth map creation with the number of workers.
+static const bool RUN_DEPTH_MAP_BENCHMARK = false;
+
+// Time the bar feature searches with and without the predicted search regions.
+static const bool RUN_SEARCH_REGION_BENCHMARK = false;
 
 //****************************************************************************
 // Structure of the example data.
@@ -102,6 +138,7 @@ struct SAlignmentData
    std::array<MIL_UNIQUE_3DDISP_ID, NUM_SCANS> MilDisplay3d;
    std::array<MIL_ID              , NUM_SCANS> MilGraphicList3d;
    std::array<MIL_UNIQUE_BUF_ID   , NUM_SCANS> MilToAlignPointClouds;
+   std::array<SValidityIndex      , NUM_SCANS> ValidityIndices;
    bool IsValid = true;
    };
 
@@ -119,10 +156,20 @@ struct SBGR32Color
 //****************************************************************************
 // Function declaration.
 //****************************************************************************
-bool FindTransformationMatrices(MIL_ID MilSystem);
-MIL_INT MergeFromRestoredMatrices(MIL_ID MilSystem);
+bool FindTransformationMatrices(MIL_ID MilSystem, const SAlignmentParams& Params, CDisplayFeed& DisplayFeed);
+MIL_INT MergeFromRestoredMatrices(MIL_ID MilSystem, const SAlignmentParams& Params, CDisplayFeed& DisplayFeed);
+SAlignmentParams TuneParameters(MIL_ID MilSystem, const SAlignmentParams& Params);
+void RunReplayBenchmark(MIL_ID MilSystem, const SAlignmentParams& Params);
 SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], bool AddNormalIfMissing = false);
-void MergeAndShowAligned(MIL_ID MilSystem, const std::vector<MIL_ID>& MilToAlignPointClouds);
+void MergeAndShowAligned(MIL_ID MilSystem, const std::vector<MIL_ID>& MilToAlignPointClouds,
+                         const std::vector<const SValidityIndex*>& ValidityIndices, const SAlignmentParams& Params,
+                         const MIL_STRING& ExportName, CDisplayFeed& DisplayFeed);
+bool MergeOutOfCoreAndShow(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], const SAlignmentParams& Params,
+                           const MIL_STRING& FilePrefix, CDisplayFeed& DisplayFeed);
+bool MergeQuantizedAndShow(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], const SAlignmentParams& Params,
+                           const MIL_STRING& ExportName, CDisplayFeed& DisplayFeed);
+void ExportAndReport(MIL_ID MilPointCloud, const MIL_STRING& FileName, const SValidityIndex* pValidity = nullptr);
+std::vector<const SValidityIndex*> GetValidityIndices(const SAlignmentData& AlignmentData);
 MIL_UNIQUE_3DDISP_ID Alloc3dDisplayId(MIL_ID MilSystem);
 MIL_UNIQUE_3DDISP_ID Alloc3dDisplayId(MIL_ID MilSystem, MIL_INT PositionX, MIL_INT PositionY,
                                       MIL_INT SizeX, MIL_INT SizeY, const MIL_STRING& Title);
@@ -143,11 +190,27 @@ int MosMain(void)
    auto MilApplication = MappAlloc(M_NULL, M_DEFAULT, M_UNIQUE_ID);
    auto MilSystem = MsysAlloc(MilApplication, M_SYSTEM_HOST, M_DEFAULT, M_DEFAULT, M_UNIQUE_ID);
 
+   // Restore the alignment parameters if they were tuned.
+   SAlignmentParams Params;
+   if(LoadAlignmentParams(FILE_ALIGNMENT_PARAMS, Params))
+      MosPrintf(MIL_TEXT("The alignment parameters were restored from %s.\n\n"), FILE_ALIGNMENT_PARAMS.c_str());
+
+   // Allocate the persistent display of the aligned point clouds.
+   CDisplayFeed DisplayFeed(MilSystem, [&]() { return Alloc3dDisplayId(MilSystem); });
+
    // Find transformation matrices using a tool.
-   if(!FindTransformationMatrices(MilSystem)) return EXIT_FAILURE;
+   if(!FindTransformationMatrices(MilSystem, Params, DisplayFeed)) return EXIT_FAILURE;
+
+   // Tune the parameters against the reference calibration.
+   if(RUN_PARAMETER_TUNING)
+      Params = TuneParameters(MilSystem, Params);
 
    // Restore transformation matrices to align PC.
-   MergeFromRestoredMatrices(MilSystem);
+   MergeFromRestoredMatrices(MilSystem, Params, DisplayFeed);
+
+   // Find the maximum line rate that the merge sustains with virtual cameras.
+   if(RUN_REPLAY_BENCHMARK)
+      RunReplayBenchmark(MilSystem, Params);
 
    return 0;
    }
@@ -158,10 +221,22 @@ int MosMain(void)
 SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], bool AddNormalIfMissing)
    {
    SAlignmentData AlignmentData;
+
+   // The levels of detail of the scans are built by threads while the next scans are restored.
+   std::array<MIL_UNIQUE_BUF_ID, NUM_SCANS> MilLodPointClouds;
+   std::vector<std::thread> LodThreads;
+   auto JoinLodThreads = [&]()
+      {
+      for(auto& LodThread : LodThreads)
+         LodThread.join();
+      LodThreads.clear();
+      };
+
    for(MIL_INT f = 0; f < NUM_SCANS; f++)
       {
       if(!CheckForRequiredMILFile(PointCloudFiles[f]))
          {
+         JoinLodThreads();
          AlignmentData.IsValid = false;
          return AlignmentData;
          }
@@ -170,12 +245,16 @@ SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR
       AlignmentData.MilToAlignPointClouds[f] = MbufImport(PointCloudFiles[f], M_DEFAULT, M_RESTORE, MilSystem, M_UNIQUE_ID);
       MbufConvert3d(AlignmentData.MilToAlignPointClouds[f], AlignmentData.MilToAlignPointClouds[f], M_NULL, M_DEFAULT, M_DEFAULT);
 
+      // Index the runs of valid points once; the later stages only visit them.
+      AlignmentData.ValidityIndices[f] = BuildValidityIndex(AlignmentData.MilToAlignPointClouds[f]);
+
       // Allocate the display.
       const auto DispInfo = DST_DISPLAY_INFO[f];
       AlignmentData.MilDisplay3d[f] = Alloc3dDisplayId(MilSystem, DispInfo.PositionX, DispInfo.PositionY,
                                                        DispInfo.Size, DispInfo.Size, DispInfo.Title);
       if(!AlignmentData.MilDisplay3d[f])
          {
+         JoinLodThreads();
          AlignmentData.IsValid = false;
          return AlignmentData;
          }
@@ -185,9 +264,23 @@ SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR
       if(AddNormalIfMissing && MbufInquireContainer(AlignmentData.MilToAlignPointClouds[f], M_COMPONENT_NORMALS_MIL, M_COMPONENT_ID, M_NULL) == M_NULL)
          M3dimNormals(M_NORMALS_CONTEXT_ORGANIZED, AlignmentData.MilToAlignPointClouds[f], AlignmentData.MilToAlignPointClouds[f], M_DEFAULT);
 
-      // Show the point cloud.
+      // Build the level of detail of the point cloud.
+      MilLodPointClouds[f] = AllocLodPointCloud(MilSystem);
+      auto LodAccess = AccessPointCloud(MilLodPointClouds[f]);
+      auto Access = AccessPointCloud(AlignmentData.MilToAlignPointClouds[f]);
+      SetValidityIndex(Access, &AlignmentData.ValidityIndices[f]);
+      LodThreads.emplace_back([Access = std::move(Access), LodAccess = std::move(LodAccess)]() mutable
+         {
+         FillLodPointCloud(Access, LodAccess);
+         });
+      }
+   JoinLodThreads();
+
+   // Show the levels of detail of the point clouds.
+   for(MIL_INT f = 0; f < NUM_SCANS; f++)
+      {
       M3ddispControl(AlignmentData.MilDisplay3d[f], M_UPDATE, M_DISABLE);
-      MIL_INT64 PointCloudLabel = M3dgraAdd(AlignmentData.MilGraphicList3d[f], M_DEFAULT, AlignmentData.MilToAlignPointClouds[f], M_NO_LINK);
+      MIL_INT64 PointCloudLabel = M3dgraAdd(AlignmentData.MilGraphicList3d[f], M_DEFAULT, MilLodPointClouds[f], M_NO_LINK);
       M3ddispSetView(AlignmentData.MilDisplay3d[f], M_AUTO, M_BOTTOM_TILTED, M_DEFAULT, M_DEFAULT, M_DEFAULT);
       M3ddispSelect(AlignmentData.MilDisplay3d[f], M_NULL, M_OPEN, M_DEFAULT);
       M3dgraControl(AlignmentData.MilGraphicList3d[f], PointCloudLabel, M_COLOR_USE_LUT, M_TRUE);
@@ -197,7 +290,16 @@ SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR
       M3ddispControl(AlignmentData.MilDisplay3d[f], M_UPDATE, M_ENABLE);
       }
 
+   MIL_INT NbPoints = 0;
+   MIL_INT NbValidPoints = 0;
+   for(const auto& ValidityIndex : AlignmentData.ValidityIndices)
+      {
+      NbPoints += ValidityIndex.SizeX * ValidityIndex.SizeY;
+      NbValidPoints += ValidityIndex.NbValidPoints;
+      }
    MosPrintf(MIL_TEXT("All 3D point cloud are restored from files and displayed.\n"));
+   if(NbPoints > 0)
+      MosPrintf(MIL_TEXT("%.1f%% of the points are valid.\n"), 100.0 * NbValidPoints / NbPoints);
    MosPrintf(MIL_TEXT("Press any key to continue.\n\n"));
    MosGetch();
 
@@ -207,7 +309,7 @@ SAlignmentData RestoreAndShowAlignmentData(MIL_ID MilSystem, MIL_CONST_TEXT_PTR
 //*****************************************************************************
 // Find transformation matrices using simple bar with holes.
 //*****************************************************************************
-bool FindTransformationMatrices(MIL_ID MilSystem)
+bool FindTransformationMatrices(MIL_ID MilSystem, const SAlignmentParams& Params, CDisplayFeed& DisplayFeed)
    {
    // Allocate the display for 2D processing.
    auto MilDisplay = MdispAlloc(MilSystem, M_DEFAULT, MIL_TEXT("M_DEFAULT"), M_WINDOWED, M_UNIQUE_ID);
@@ -222,20 +324,28 @@ bool FindTransformationMatrices(MIL_ID MilSystem)
    MIL_DOUBLE RefCircleXPos = 0.0;
    MIL_DOUBLE RefCircleYPos = 0.0;
 
+   // The search regions of the next cameras are predicted from the shapes found.
+   SPredictedSearchRegions SearchRegions;
+   std::vector<SPredictedSearchTiming> SearchTimings;
+
    auto Colors = GetDistinctColors(NUM_SCANS);
 
    for (MIL_INT i = 0; i < NUM_SCANS; i++)
       {
       MIL_ID MilToAlignPointCloud = AlignmentData.MilToAlignPointClouds[i];
 
-      auto FindBarPlaneResult = FindRotationYAndTranslationZ(MilSystem, MilToAlignPointCloud, AlignmentData.MilGraphicList3d[i], i);
+      auto FindBarPlaneResult = FindRotationYAndTranslationZ(MilSystem, MilToAlignPointCloud, AlignmentData.MilGraphicList3d[i], i, Params);
       if (!FindBarPlaneResult.IsValid)
          return false;
 
       // Create depth map for primary scan.
-      MIL_UNIQUE_BUF_ID MilDepthMap = CreateDepthMap(MilSystem, FindBarPlaneResult.MilTransformedPointCloud);
+      MIL_UNIQUE_BUF_ID MilDepthMap = CreateDepthMap(MilSystem, FindBarPlaneResult.MilTransformedPointCloud, Params);
       if (i == 0)
          {
+         if(RUN_DEPTH_MAP_BENCHMARK && !BenchmarkDepthMapCreation(MilSystem, FindBarPlaneResult.MilTransformedPointCloud, Params) &&
+            USE_TILED_DEPTH_MAP)
+            MosPrintf(MIL_TEXT("The tiled depth map differs from the single pass; disable USE_TILED_DEPTH_MAP.\n\n"));
+
          // Display the depthmap for first iteration.
          MdispControl(MilDisplay, M_TITLE, MIL_TEXT("Depthmap"));
          MdispControl(MilDisplay, M_WINDOW_INITIAL_POSITION_Y, DISP_DEPTH_MAP_POS_Y);
@@ -246,22 +356,19 @@ bool FindTransformationMatrices(MIL_ID MilSystem)
          MosPrintf(MIL_TEXT("so that they can be superimposed on each other.\n"));
          }
 
-      // Run modelfinder to find circle shape.
-      MIL_INT NumOccurences;
-      auto MilModResultCircle = SimpleShapeSearch<SCircleShapeParamAndResult>(MilSystem, MilDisplay, MilDepthMap, M_DEFAULT, HOLE_RADIUS, i);
-      MmodGetResult(MilModResultCircle, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &NumOccurences);
-      if (NumOccurences < 1)
+      if(RUN_SEARCH_REGION_BENCHMARK && i > 0)
+         SearchTimings.push_back(TimePredictedSearch(MilSystem, MilDepthMap, Params, SearchRegions, i));
+
+      // Run modelfinder to find the circle shapes and the segments.
+      auto Features = FindBarFeatures(MilSystem, MilDisplay, MilDepthMap, i, Params, SearchRegions);
+      if (Features.NbCircles < 1)
          {
          MosPrintf(MIL_TEXT("At least one circle must be found to continue.\n\n"));
          MosPrintf(MIL_TEXT("Press any key to end.\n\n"));
          return false;
          }
 
-      // Run modelfinder to find segment.
-      //auto MilModResultSegment = SegmentSearch(MilSystem, MilDisplay, MilDepthMap, i);
-      auto MilModResultSegment = SimpleShapeSearch<SSegmentShapeParamAndResult>(MilSystem, MilDisplay, MilDepthMap, SEGMENT_LENGTH, M_DEFAULT, i);
-      MmodGetResult(MilModResultSegment, M_DEFAULT, M_NUMBER + M_TYPE_MIL_INT, &NumOccurences);
-      if (NumOccurences < 1)
+      if (Features.NbSegments < 1)
          {
          MosPrintf(MIL_TEXT("No segment were found.\n\n"));
          MosPrintf(MIL_TEXT("Press any key to end.\n\n"));
@@ -269,12 +376,13 @@ bool FindTransformationMatrices(MIL_ID MilSystem)
          }
 
       // Get the position of the circle and the axis from the segment.
-      MIL_DOUBLE CircleXPos;
-      MIL_DOUBLE CircleYPos;
-      MmodGetResult(MilModResultCircle, 0, M_POSITION_X, &CircleXPos);
-      MmodGetResult(MilModResultCircle, 0, M_POSITION_Y, &CircleYPos);
-      SUnitVector2d AxisVector = GetAxisFromSegments(MilModResultSegment, MilDisplay, i);
-      
+      MIL_DOUBLE CircleXPos = Features.CircleXPos;
+      MIL_DOUBLE CircleYPos = Features.CircleYPos;
+      MIL_INT EdgeIndex;
+      SUnitVector2d AxisVector = GetAxisFromSegments(Features.MilSegmentResult, MilDisplay, i, &EdgeIndex);
+      SearchRegions.UpdateCircleRegion(Features.MilCircleResult, MilDepthMap, Features.CircleSearchOffsetY);
+      SearchRegions.UpdateSegmentRegion(Features.MilSegmentResult, EdgeIndex, MilDepthMap, Features.SegmentSearchOffsetY);
+
       if (i == 0)
          {
          RefCircleXPos = CircleXPos;
@@ -289,26 +397,26 @@ bool FindTransformationMatrices(MIL_ID MilSystem)
       // Create the matrix and save it to file.
       auto MilTransformMatrix = M3dgeoAlloc(M_DEFAULT_HOST, M_TRANSFORMATION_MATRIX, M_DEFAULT, M_UNIQUE_ID);
       GetMatrixTransform(MilTransformMatrix, AxisVector, RefCircleXPos, RefCircleYPos, CircleXPos, CircleYPos, i * BAR_HOLES_DISTANCE_X);
-      MIL_DOUBLE Rx, Ry, Rz, Tx, Ty, Tz;
-      M3dgeoMatrixGetTransform(MilTransformMatrix, M_TRANSLATION, &Tx, &Ty, &Tz, M_NULL, M_DEFAULT);
-      M3dgeoMatrixSetTransform(MilTransformMatrix, M_ROTATION_Y, FindBarPlaneResult.Transformation.RY, M_DEFAULT, M_DEFAULT, M_DEFAULT, M_ASSIGN);
-      M3dgeoMatrixSetTransform(MilTransformMatrix, M_TRANSLATION, Tx, Ty, FindBarPlaneResult.Transformation.TZ + Tz, M_DEFAULT, M_COMPOSE_WITH_CURRENT);
+      ComposeBarPlaneTransform(MilTransformMatrix, FindBarPlaneResult.Transformation);
       M3dgeoSave(BuildCameraTransformationMatrixName(i), MilTransformMatrix, M_DEFAULT);
 
       // Print transformation.
+      MIL_DOUBLE Rx, Ry, Rz, Tx, Ty, Tz;
       M3dgeoMatrixGetTransform(MilTransformMatrix, M_TRANSLATION, &Tx, &Ty, &Tz, M_NULL, M_DEFAULT);
       M3dgeoMatrixGetTransform(MilTransformMatrix, M_ROTATION_XYZ, &Rx, &Ry, &Rz, M_NULL, M_DEFAULT);
       MosPrintf(MIL_TEXT("|%13d|%9.2f|%9.2f|%9.2f|%9.2f|%9.2f|%9.2f|\n"), i, Tx, Ty, Tz, Rx, Ry, Rz);
       
-      // Transform the point cloud.
-      M3dimMatrixTransform(MilToAlignPointCloud, MilToAlignPointCloud, MilTransformMatrix, M_DEFAULT);
+      // Transform the valid points of the point cloud.
+      TransformValidPoints(MilToAlignPointCloud, MilTransformMatrix, &AlignmentData.ValidityIndices[i]);
 
       // Color the points.
       ColorCloud(MilToAlignPointCloud, M_RGB888(Colors[i].R, Colors[i].G, Colors[i].B));
       }
+   PrintPredictedSearchTimings(SearchTimings);
 
    // Merge and show the aligned point cloud.
-   MergeAndShowAligned(MilSystem, std::vector<MIL_ID>(AlignmentData.MilToAlignPointClouds.begin(), AlignmentData.MilToAlignPointClouds.end()));
+   MergeAndShowAligned(MilSystem, std::vector<MIL_ID>(AlignmentData.MilToAlignPointClouds.begin(), AlignmentData.MilToAlignPointClouds.end()),
+                       GetValidityIndices(AlignmentData), Params, FILE_EXPORT_BAR, DisplayFeed);
 
    return true;
    }
@@ -316,53 +424,289 @@ bool FindTransformationMatrices(MIL_ID MilSystem)
 //*****************************************************************************
 // Merge point clouds from restored transformation matrices.
 //*****************************************************************************
-MIL_INT MergeFromRestoredMatrices(MIL_ID MilSystem)
+MIL_INT MergeFromRestoredMatrices(MIL_ID MilSystem, const SAlignmentParams& Params, CDisplayFeed& DisplayFeed)
    {
    MosPrintf(MIL_TEXT("If you already have you transformation matrices, you can simply restore them.\n"));
 
+   // The out-of-core and quantized merges restore the scans one at a time instead of keeping them all in memory.
+   if(USE_OUT_OF_CORE_MERGE)
+      return MergeOutOfCoreAndShow(MilSystem, FILE_POINT_CLOUD_KEYBOARD, Params, FILE_EXPORT_KEYBOARD, DisplayFeed) ? 0 : -1;
+   if(USE_QUANTIZED_MERGE)
+      return MergeQuantizedAndShow(MilSystem, FILE_POINT_CLOUD_KEYBOARD, Params, FILE_EXPORT_KEYBOARD, DisplayFeed) ? 0 : -1;
+
    // Restore and show the point cloud data.
    auto AlignmentData = RestoreAndShowAlignmentData(MilSystem, FILE_POINT_CLOUD_KEYBOARD);
    if(!AlignmentData.IsValid)
       return -1;
 
-   // Transform the point clouds.
+   // Transform the valid points of the point clouds.
    for (MIL_INT i = 0; i < NUM_SCANS; i++)
       {
       M3ddispControl(AlignmentData.MilDisplay3d[i], M_UPDATE, M_DISABLE);
       auto MilTransformMatrix = M3dgeoRestore(BuildCameraTransformationMatrixName(i), MilSystem, M_DEFAULT, M_UNIQUE_ID);
-      M3dimMatrixTransform(AlignmentData.MilToAlignPointClouds[i], AlignmentData.MilToAlignPointClouds[i], MilTransformMatrix, M_DEFAULT);
+      TransformValidPoints(AlignmentData.MilToAlignPointClouds[i], MilTransformMatrix, &AlignmentData.ValidityIndices[i]);
       }
 
    // Merge and show the aligned point cloud.
-   MergeAndShowAligned(MilSystem, std::vector<MIL_ID>(AlignmentData.MilToAlignPointClouds.begin(), AlignmentData.MilToAlignPointClouds.end()));
+   MergeAndShowAligned(MilSystem, std::vector<MIL_ID>(AlignmentData.MilToAlignPointClouds.begin(), AlignmentData.MilToAlignPointClouds.end()),
+                       GetValidityIndices(AlignmentData), Params, FILE_EXPORT_KEYBOARD, DisplayFeed);
 
    return 0;
    }
 
+//*****************************************************************************
+// Tune the alignment parameters against the reference calibration.
+//*****************************************************************************
+SAlignmentParams TuneParameters(MIL_ID MilSystem, const SAlignmentParams& Params)
+   {
+   // Restore the point clouds and the reference matrices.
+   std::vector<MIL_UNIQUE_BUF_ID> MilPointClouds;
+   for(MIL_INT i = 0; i < NUM_SCANS; i++)
+      {
+      MilPointClouds.push_back(MbufImport(FILE_POINT_CLOUD[i], M_DEFAULT, M_RESTORE, MilSystem, M_UNIQUE_ID));
+      MbufConvert3d(MilPointClouds[i], MilPointClouds[i], M_NULL, M_DEFAULT, M_DEFAULT);
+      if(MbufInquireContainer(MilPointClouds[i], M_COMPONENT_NORMALS_MIL, M_COMPONENT_ID, M_NULL) == M_NULL)
+         M3dimNormals(M_NORMALS_CONTEXT_ORGANIZED, MilPointClouds[i], MilPointClouds[i], M_DEFAULT);
+      }
+   std::vector<MIL_ID> MilPointCloudIds(MilPointClouds.begin(), MilPointClouds.end());
+
+   // Without a measured reference calibration, only the merge decimation step is tuned.
+   std::vector<MIL_UNIQUE_3DGEO_ID> MilRefMatrices;
+   RestoreReferenceMatrices(MilSystem, NUM_SCANS, MilRefMatrices);
+
+   auto TunedParams = TuneAlignmentParameters(MilSystem, MilPointCloudIds, std::vector<MIL_ID>(MilRefMatrices.begin(), MilRefMatrices.end()),
+                                              Params, BAR_HOLES_DISTANCE_X);
+
+   MosPrintf(MIL_TEXT("Press any key to continue.\n\n"));
+   MosGetch();
+   return TunedParams;
+   }
+
+//*****************************************************************************
+// Replay the scans, or generated ones, with virtual cameras to find the maximum
+// line rate that the merge sustains.
+//*****************************************************************************
+void RunReplayBenchmark(MIL_ID MilSystem, const SAlignmentParams& Params)
+   {
+   std::vector<MIL_UNIQUE_BUF_ID> MilScans;
+   std::vector<MIL_UNIQUE_3DGEO_ID> MilMatrices;
+   for(MIL_INT i = 0; i < NUM_SCANS; i++)
+      {
+      if(REPLAY_USE_GENERATED_SCANS)
+         {
+         MilScans.push_back(GenerateReplayScan(MilSystem, REPLAY_GENERATED_SIZE_X, REPLAY_GENERATED_SIZE_Y));
+         MilMatrices.push_back(M3dgeoAlloc(MilSystem, M_TRANSFORMATION_MATRIX, M_DEFAULT, M_UNIQUE_ID));
+         }
+      else
+         {
+         if(!CheckForRequiredMILFile(FILE_POINT_CLOUD_KEYBOARD[i]))
+            return;
+         MilScans.push_back(MbufImport(FILE_POINT_CLOUD_KEYBOARD[i], M_DEFAULT, M_RESTORE, MilSystem, M_UNIQUE_ID));
+         MbufConvert3d(MilScans[i], MilScans[i], M_NULL, M_DEFAULT, M_DEFAULT);
+         MilMatrices.push_back(M3dgeoRestore(BuildCameraTransformationMatrixName(i), MilSystem, M_DEFAULT, M_UNIQUE_ID));
+         }
+      }
+
+   SReplayParams ReplayParams;
+   ReplayParams.MergeDecimationStep = Params.MergeDecimationStep;
+   FindMaxSustainableLineRate(MilSystem, std::vector<MIL_ID>(MilScans.begin(), MilScans.end()),
+                              std::vector<MIL_ID>(MilMatrices.begin(), MilMatrices.end()), ReplayParams);
+
+   MosPrintf(MIL_TEXT("Press any key to continue.\n\n"));
+   MosGetch();
+   }
+
 //*****************************************************************************
 // Merge and show the aligned point cloud.
 //*****************************************************************************
-void MergeAndShowAligned(MIL_ID MilSystem, const std::vector<MIL_ID>& MilToAlignPointClouds)
+void MergeAndShowAligned(MIL_ID MilSystem, const std::vector<MIL_ID>& MilToAlignPointClouds,
+                         const std::vector<const SValidityIndex*>& ValidityIndices, const SAlignmentParams& Params,
+                         const MIL_STRING& ExportName, CDisplayFeed& DisplayFeed)
+   {
+   // Merge the decimated valid points of the point clouds.
+   auto MilMergedPointClouds = MergeValidPoints(MilSystem, MilToAlignPointClouds, ValidityIndices, Params.MergeDecimationStep);
+
+   // Export the aligned point clouds.
+   if(EXPORT_ALIGNED_POINT_CLOUDS)
+      {
+      for(MIL_INT i = 0; i < (MIL_INT)MilToAlignPointClouds.size(); i++)
+         ExportAndReport(MilToAlignPointClouds[i], ExportName + MIL_TEXT("MR") + M_TO_STRING(i + 1) + GetExportFileExtension(EXPORT_FORMAT),
+                         ValidityIndices[i]);
+      }
+   if(EXPORT_MERGED_POINT_CLOUD)
+      ExportAndReport(MilMergedPointClouds, ExportName + MIL_TEXT("Merged") + GetExportFileExtension(EXPORT_FORMAT));
+
+   // Display the level of detail of the transformed grabbed point clouds.
+   DisplayFeed.Submit(std::move(MilMergedPointClouds));
+   MosPrintf(MIL_TEXT("The alignment of the 3D data is displayed.\n"));
+   MosPrintf(MIL_TEXT("Press any key to continue the example.\n\n"));
+   MosGetch();
+   }
+
+//*****************************************************************************
+// Merge the aligned point clouds out of core, in independent tile files, and
+// show the most populated tile. The scans are restored and added one at a
+// time, so the memory used is the cap of the merger plus one scan.
+//*****************************************************************************
+bool MergeOutOfCoreAndShow(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], const SAlignmentParams& Params,
+                           const MIL_STRING& FilePrefix, CDisplayFeed& DisplayFeed)
+   {
+   MIL_DOUBLE MergeTime;
+   MappTimer(M_DEFAULT, M_TIMER_RESET + M_SYNCHRONOUS, M_NULL);
+   CTiledMerger TiledMerger(FilePrefix, TILED_MERGE_TILE_SIZE_Y, Params.MergeDecimationStep, TILED_MERGE_MEMORY_CAP);
+   for(MIL_INT i = 0; i < NUM_SCANS; i++)
+      {
+      if(!CheckForRequiredMILFile(PointCloudFiles[i]))
+         return false;
+      auto MilPointCloud = MbufImport(PointCloudFiles[i], M_DEFAULT, M_RESTORE, MilSystem, M_UNIQUE_ID);
+      MbufConvert3d(MilPointCloud, MilPointCloud, M_NULL, M_DEFAULT, M_DEFAULT);
+      auto MilTransformMatrix = M3dgeoRestore(BuildCameraTransformationMatrixName(i), MilSystem, M_DEFAULT, M_UNIQUE_ID);
+      if(!TiledMerger.AddPointCloud(MilPointCloud, MilTransformMatrix))
+         {
+         MosPrintf(MIL_TEXT("The point cloud %d could not be added to the merged tiles.\n\n"), (int)i);
+         return false;
+         }
+      }
+   auto Tiles = TiledMerger.Finalize(EXPORT_FORMAT);
+   MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &MergeTime);
+
+   MIL_UINT64 NbPoints = 0;
+   MIL_INT LargestTile = 0;
+   for(MIL_INT t = 0; t < (MIL_INT)Tiles.size(); t++)
+      {
+      NbPoints += Tiles[t].NbPoints;
+      if(Tiles[t].NbPoints > Tiles[LargestTile].NbPoints)
+         LargestTile = t;
+      }
+   MosPrintf(MIL_TEXT("The point clouds were merged out of core in %d tiles of %.0f mm along Y\n"), (int)Tiles.size(), TILED_MERGE_TILE_SIZE_Y);
+   MosPrintf(MIL_TEXT("(%llu points in %.1f ms).\n\n"), (unsigned long long)NbPoints, MergeTime * 1000.0);
+   if(Tiles.empty())
+      return true;
+
+   // Restore and display the most populated tile.
+   auto MilTile = RestoreTiledPointCloud(MilSystem, Tiles[LargestTile].FileName);
+   if(!MilTile)
+      return false;
+   DisplayFeed.Submit(std::move(MilTile));
+   MosPrintf(MIL_TEXT("The tile %s (Y from %.0f to %.0f mm) is displayed.\n"),
+             Tiles[LargestTile].FileName.c_str(), Tiles[LargestTile].MinY, Tiles[LargestTile].MaxY);
+   MosPrintf(MIL_TEXT("Press any key to continue the example.\n\n"));
+   MosGetch();
+   return true;
+   }
+
+//*****************************************************************************
+// Quantize the point clouds, then transform and merge them in the quantized
+// representation. The merged points are only dequantized to be exported. The
+// scans are restored and quantized one at a time, so only their 16-bit copies
+// are kept.
+//*****************************************************************************
+bool MergeQuantizedAndShow(MIL_ID MilSystem, MIL_CONST_TEXT_PTR PointCloudFiles[], const SAlignmentParams& Params,
+                           const MIL_STRING& ExportName, CDisplayFeed& DisplayFeed)
    {
-   // Use decimation for subsampling.
-   MIL_UNIQUE_3DIM_ID MilSubsampleContext = M3dimAlloc(MilSystem, M_SUBSAMPLE_CONTEXT, M_DEFAULT, M_UNIQUE_ID);
-   M3dimControl(MilSubsampleContext, M_SUBSAMPLE_MODE, M_SUBSAMPLE_DECIMATE);
-   M3dimControl(MilSubsampleContext, M_ORGANIZATION_TYPE, M_ORGANIZED);
-   M3dimControl(MilSubsampleContext, M_STEP_SIZE_X, MERGE_DECIMATION_STEP);
-   M3dimControl(MilSubsampleContext, M_STEP_SIZE_Y, MERGE_DECIMATION_STEP);
-
-   // Merge the point clouds   
-   auto MilMergedPointClouds = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
-   M3dimMerge(MilToAlignPointClouds, MilMergedPointClouds, M_DEFAULT, MilSubsampleContext, M_DEFAULT);
-
-   // Display the transformed grabbed point clouds.
-   auto MilAligned3dDisp = Alloc3dDisplayId(MilSystem);
-   M3ddispSetView(MilAligned3dDisp, M_AUTO, M_BOTTOM_TILTED, M_DEFAULT, M_DEFAULT, M_DEFAULT);
-   M3ddispSetView(MilAligned3dDisp, M_FLIP, M_AXIS_Y, M_DEFAULT, M_DEFAULT, M_DEFAULT);
-   M3ddispSelect(MilAligned3dDisp, MilMergedPointClouds, M_SELECT, M_DEFAULT);
+   MIL_DOUBLE QuantizeTime = 0.0, MergeTime;
+   std::vector<SQuantizedPointCloud> QuantizedPointClouds;
+   std::vector<MIL_UNIQUE_3DGEO_ID> MilTransformMatrices;
+   std::vector<SQuantizedTransformCheck> Checks;
+   for(MIL_INT i = 0; i < NUM_SCANS; i++)
+      {
+      if(!CheckForRequiredMILFile(PointCloudFiles[i]))
+         return false;
+      auto MilPointCloud = MbufImport(PointCloudFiles[i], M_DEFAULT, M_RESTORE, MilSystem, M_UNIQUE_ID);
+      MbufConvert3d(MilPointCloud, MilPointCloud, M_NULL, M_DEFAULT, M_DEFAULT);
+      MilTransformMatrices.push_back(M3dgeoRestore(BuildCameraTransformationMatrixName(i), MilSystem, M_DEFAULT, M_UNIQUE_ID));
+
+      MIL_DOUBLE Time;
+      MappTimer(M_DEFAULT, M_TIMER_RESET + M_SYNCHRONOUS, M_NULL);
+      QuantizedPointClouds.push_back(QuantizePointCloud(MilPointCloud));
+      MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &Time);
+      QuantizeTime += Time;
+
+      if(CHECK_QUANTIZED_TRANSFORM)
+         Checks.push_back(CheckQuantizedTransform(MilPointCloud, QuantizedPointClouds.back(), MilTransformMatrices.back()));
+      }
+   std::vector<MIL_ID> MilMatrices(MilTransformMatrices.begin(), MilTransformMatrices.end());
+
+   std::vector<const SQuantizedPointCloud*> PointClouds;
+   for(const auto& QuantizedPointCloud : QuantizedPointClouds)
+      PointClouds.push_back(&QuantizedPointCloud);
+   MappTimer(M_DEFAULT, M_TIMER_RESET + M_SYNCHRONOUS, M_NULL);
+   auto Merged = MergeQuantizedPointClouds(PointClouds, MilMatrices, Params.MergeDecimationStep);
+   MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &MergeTime);
+
+   MIL_UINT64 NbQuantizedBytes = 0;
+   MIL_UINT64 NbFloatBytes = 0;
+   for(const auto& QuantizedPointCloud : QuantizedPointClouds)
+      {
+      NbQuantizedBytes += QuantizedPointCloud.NbBytes();
+      NbFloatBytes += QuantizedPointCloud.NbPoints() * (3 * sizeof(MIL_FLOAT) + (QuantizedPointCloud.HasColor() ? 3 : 0));
+      }
+   MosPrintf(MIL_TEXT("The point clouds were quantized to 16 bits in %.1f ms (%.1f MB instead of %.1f MB).\n"),
+             QuantizeTime * 1000.0, NbQuantizedBytes / (1024.0 * 1024.0), NbFloatBytes / (1024.0 * 1024.0));
+   MosPrintf(MIL_TEXT("The quantized point clouds were transformed and merged in %.1f ms.\n\n"), MergeTime * 1000.0);
+
+   // Report the error of the quantized transform against the transform of the point clouds.
+   if(!Checks.empty())
+      {
+      MosPrintf(MIL_TEXT("Maximum error of the quantized transform, in levels:\n\n"));
+      MosPrintf(MIL_TEXT("|------|---------|-------|-------|-------|---------|\n"));
+      MosPrintf(MIL_TEXT("| Scan |  Points |   X   |   Y   |   Z   | Result  |\n"));
+      MosPrintf(MIL_TEXT("|------|---------|-------|-------|-------|---------|\n"));
+      for(MIL_INT i = 0; i < (MIL_INT)Checks.size(); i++)
+         {
+         const auto& Check = Checks[i];
+         MosPrintf(MIL_TEXT("|%6d|%9d|%7.2f|%7.2f|%7.2f|%9s|\n"), (int)(i + 1), (int)Check.NbPoints,
+                   Check.MaxLevelError[0], Check.MaxLevelError[1], Check.MaxLevelError[2],
+                   Check.IsWithinOneLevel() ? MIL_TEXT("ok") : MIL_TEXT("EXCEEDS"));
+         }
+      MosPrintf(MIL_TEXT("|------|---------|-------|-------|-------|---------|\n\n"));
+      }
+
+   // Export the merged point cloud.
+   if(EXPORT_MERGED_POINT_CLOUD)
+      {
+      MIL_UINT64 NbBytesWritten = 0;
+      auto FileName = ExportName + MIL_TEXT("Merged") + GetExportFileExtension(EXPORT_FORMAT);
+      if(ExportQuantizedPointCloud(Merged, FileName, EXPORT_FORMAT, &NbBytesWritten))
+         MosPrintf(MIL_TEXT("The point cloud was exported to %s (%.1f MB).\n\n"), FileName.c_str(), NbBytesWritten / (1024.0 * 1024.0));
+      }
+
+   // Display the level of detail of the merged point cloud from its quantized range.
+   DisplayFeed.Submit(AllocQuantizedContainer(MilSystem, Merged));
    MosPrintf(MIL_TEXT("The alignment of the 3D data is displayed.\n"));
    MosPrintf(MIL_TEXT("Press any key to continue the example.\n\n"));
    MosGetch();
+   return true;
+   }
+
+//*****************************************************************************
+// Export a point cloud and report the throughput.
+//*****************************************************************************
+void ExportAndReport(MIL_ID MilPointCloud, const MIL_STRING& FileName, const SValidityIndex* pValidity)
+   {
+   MIL_DOUBLE ExportTime;
+   MIL_UINT64 NbBytesWritten = 0;
+   MappTimer(M_DEFAULT, M_TIMER_RESET + M_SYNCHRONOUS, M_NULL);
+   bool Exported = ExportPointCloud(MilPointCloud, FileName, EXPORT_FORMAT, &NbBytesWritten, pValidity);
+   MappTimer(M_DEFAULT, M_TIMER_READ + M_SYNCHRONOUS, &ExportTime);
+
+   if(Exported)
+      {
+      MIL_DOUBLE NbMBytes = NbBytesWritten / (1024.0 * 1024.0);
+      MosPrintf(MIL_TEXT("The point cloud was exported to %s (%.1f MB in %.1f ms, %.0f MB/s).\n\n"),
+                FileName.c_str(), NbMBytes, ExportTime * 1000.0, ExportTime > 0.0 ? NbMBytes / ExportTime : 0.0);
+      }
+   }
+
+//*****************************************************************************
+// Get the validity indices of the restored point clouds.
+//*****************************************************************************
+std::vector<const SValidityIndex*> GetValidityIndices(const SAlignmentData& AlignmentData)
+   {
+   std::vector<const SValidityIndex*> ValidityIndices;
+   for(const auto& ValidityIndex : AlignmentData.ValidityIndices)
+      ValidityIndices.push_back(&ValidityIndex);
+   return ValidityIndices;
    }
 
 //*****************************************************************************
@@ -0,0 +1,51 @@
+﻿//***************************************************************************************/
+// 
+// File name: ParallelTasks.h
+//
+// Synopsis: Implementation of a simple worker pool used to process independent tasks
+//           (chunks, tiles, bands) of the point clouds in parallel.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//****************************************************************************
+// Get the number of workers to use.
+//****************************************************************************
+MIL_INT GetNbWorkers(MIL_INT MaxNbWorkers = 0)
+   {
+   MIL_INT NbWorkers = std::max<MIL_INT>(1, static_cast<MIL_INT>(std::thread::hardware_concurrency()));
+   if(MaxNbWorkers > 0)
+      NbWorkers = std::min(NbWorkers, MaxNbWorkers);
+   return NbWorkers;
+   }
+
+//****************************************************************************
+// Run the tasks [0, NbTasks) on a pool of workers. Each worker picks the next
+// available task until all tasks are done. The task function receives the task
+// index and the index of the worker running it.
+//****************************************************************************
+template <class TaskFunc>
+void ParallelForEachTask(MIL_INT NbTasks, MIL_INT NbWorkers, TaskFunc Task)
+   {
+   NbWorkers = std::max<MIL_INT>(1, std::min(NbWorkers, NbTasks));
+   std::atomic<MIL_INT> NextTask(0);
+   auto WorkerLoop = [&](MIL_INT WorkerIndex)
+      {
+      for(MIL_INT t = NextTask++; t < NbTasks; t = NextTask++)
+         Task(t, WorkerIndex);
+      };
+
+   // The calling thread is used as the last worker.
+   std::vector<std::thread> Workers;
+   for(MIL_INT w = 0; w < NbWorkers - 1; w++)
+      Workers.emplace_back(WorkerLoop, w);
+   WorkerLoop(NbWorkers - 1);
+
+   for(auto& Worker : Workers)
+      Worker.join();
+   }
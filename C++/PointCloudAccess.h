@@ -0,0 +1,204 @@
+﻿//***************************************************************************************/
+// 
+// File name: PointCloudAccess.h
+//
+// Synopsis: Implementation of the direct access to the memory of the components of the
+//           point cloud containers, and of the visit of their runs of valid points, with
+//           or without a validity index.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <array>
+#include <cmath>
+#include <limits>
+
+//****************************************************************************
+// Direct access to the memory of the components of a point cloud container.
+//****************************************************************************
+struct SPointCloudAccess
+   {
+   bool IsValid = false;
+   MIL_INT SizeX = 0;
+   MIL_INT SizeY = 0;
+
+   std::array<MIL_UNIQUE_BUF_ID, 3> MilRangeBands;
+   std::array<MIL_FLOAT*, 3>        Range = {};
+   MIL_INT                          RangePitch = 0;
+
+   std::array<MIL_UNIQUE_BUF_ID, 3> MilColorBands;
+   std::array<MIL_UINT8*, 3>        Color = {};
+   MIL_INT                          ColorPitch = 0;
+
+   MIL_UINT8* Confidence = nullptr;
+   MIL_INT    ConfidencePitch = 0;
+
+   const SValidityIndex* pValidity = nullptr; // Runs of valid points, if indexed.
+
+   bool HasColor() const { return Color[0] != nullptr; }
+   MIL_INT NbPoints() const { return SizeX * SizeY; }
+
+   bool IsValidPoint(MIL_INT X, MIL_INT Y) const
+      {
+      if(Confidence && Confidence[Y * ConfidencePitch + X] == 0)
+         return false;
+      return !std::isnan(Range[2][Y * RangePitch + X]);
+      }
+   };
+
+//****************************************************************************
+// Get the host address of a buffer.
+//****************************************************************************
+template <class T>
+T* GetHostAddress(MIL_ID MilBuffer)
+   {
+   void* HostAddress = nullptr;
+   MbufInquire(MilBuffer, M_HOST_ADDRESS, &HostAddress);
+   return static_cast<T*>(HostAddress);
+   }
+
+//****************************************************************************
+// Get the direct access to the range, color and confidence of a point cloud.
+//****************************************************************************
+SPointCloudAccess AccessPointCloud(MIL_ID MilPointCloud)
+   {
+   SPointCloudAccess Access;
+
+   MIL_ID MilRange = MbufInquireContainer(MilPointCloud, M_COMPONENT_RANGE, M_COMPONENT_ID, M_NULL);
+   if(MilRange == M_NULL ||
+      MbufInquire(MilRange, M_SIZE_BAND, M_NULL) != 3 ||
+      MbufInquire(MilRange, M_TYPE, M_NULL) != 32 + M_FLOAT)
+      {
+      MosPrintf(MIL_TEXT("The point cloud must have a 3-band 32-bit floating-point range component.\n\n"));
+      return Access;
+      }
+
+   Access.SizeX = MbufInquire(MilRange, M_SIZE_X, M_NULL);
+   Access.SizeY = MbufInquire(MilRange, M_SIZE_Y, M_NULL);
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Access.MilRangeBands[b] = MbufChildColor(MilRange, b, M_UNIQUE_ID);
+      Access.Range[b] = GetHostAddress<MIL_FLOAT>(Access.MilRangeBands[b]);
+      }
+   Access.RangePitch = MbufInquire(Access.MilRangeBands[0], M_PITCH, M_NULL);
+
+   // The reflectance is exported as the color of the points if it is 8-bit.
+   MIL_ID MilReflectance = MbufInquireContainer(MilPointCloud, M_COMPONENT_REFLECTANCE, M_COMPONENT_ID, M_NULL);
+   if(MilReflectance && MbufInquire(MilReflectance, M_TYPE, M_NULL) == 8 + M_UNSIGNED)
+      {
+      MIL_INT NbColorBands = MbufInquire(MilReflectance, M_SIZE_BAND, M_NULL);
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         Access.MilColorBands[b] = MbufChildColor(MilReflectance, NbColorBands == 3 ? b : 0, M_UNIQUE_ID);
+         Access.Color[b] = GetHostAddress<MIL_UINT8>(Access.MilColorBands[b]);
+         }
+      Access.ColorPitch = MbufInquire(Access.MilColorBands[0], M_PITCH, M_NULL);
+      }
+
+   MIL_ID MilConfidence = MbufInquireContainer(MilPointCloud, M_COMPONENT_CONFIDENCE, M_COMPONENT_ID, M_NULL);
+   if(MilConfidence && MbufInquire(MilConfidence, M_TYPE, M_NULL) == 8 + M_UNSIGNED)
+      {
+      Access.Confidence = GetHostAddress<MIL_UINT8>(MilConfidence);
+      Access.ConfidencePitch = MbufInquire(MilConfidence, M_PITCH, M_NULL);
+      }
+
+   Access.IsValid = true;
+   return Access;
+   }
+
+//****************************************************************************
+// Build the validity index of a point cloud.
+//****************************************************************************
+SValidityIndex BuildValidityIndex(const SPointCloudAccess& Access)
+   {
+   return BuildValidityIndex(Access.SizeX, Access.SizeY, [&](MIL_INT X, MIL_INT Y) { return Access.IsValidPoint(X, Y); });
+   }
+
+SValidityIndex BuildValidityIndex(MIL_ID MilPointCloud)
+   {
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return SValidityIndex();
+   return BuildValidityIndex(Access);
+   }
+
+//****************************************************************************
+// Use the validity index of a point cloud, if it matches its size.
+//****************************************************************************
+void SetValidityIndex(SPointCloudAccess& Access, const SValidityIndex* pValidity)
+   {
+   if(pValidity && !pValidity->IsEmpty() && pValidity->SizeX == Access.SizeX && pValidity->SizeY == Access.SizeY)
+      Access.pValidity = pValidity;
+   }
+
+//****************************************************************************
+// Call the function on every run of consecutive valid points within the
+// [Begin, End) range of point indices, in row-major order.
+//****************************************************************************
+template <class RunFunc>
+void ForEachValidRun(const SPointCloudAccess& Access, MIL_INT Begin, MIL_INT End, RunFunc Func)
+   {
+   if(Access.pValidity)
+      {
+      Access.pValidity->ForEachRun(Begin, End, Func);
+      return;
+      }
+
+   for(MIL_INT i = Begin; i < End;)
+      {
+      MIL_INT Y = i / Access.SizeX;
+      MIL_INT X = i % Access.SizeX;
+      MIL_INT RowEnd = std::min(Access.SizeX, X + (End - i));
+      while(X < RowEnd)
+         {
+         while(X < RowEnd && !Access.IsValidPoint(X, Y))
+            X++;
+         MIL_INT RunStart = X;
+         while(X < RowEnd && Access.IsValidPoint(X, Y))
+            X++;
+         if(X > RunStart)
+            Func(RunStart, Y, X - RunStart);
+         }
+      i = Y * Access.SizeX + RowEnd;
+      }
+   }
+
+//****************************************************************************
+// Number and bounding box of the valid points of a point cloud.
+//****************************************************************************
+struct SValidPointsBox
+   {
+   MIL_INT   NbPoints = 0;
+   MIL_FLOAT Min[3];
+   MIL_FLOAT Max[3];
+   };
+
+//****************************************************************************
+// Count the valid points within the [Begin, End) range of point indices and
+// compute their bounding box.
+//****************************************************************************
+SValidPointsBox GetValidPointsBox(const SPointCloudAccess& Access, MIL_INT Begin, MIL_INT End)
+   {
+   SValidPointsBox Box;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Box.Min[b] = std::numeric_limits<MIL_FLOAT>::max();
+      Box.Max[b] = std::numeric_limits<MIL_FLOAT>::lowest();
+      }
+
+   ForEachValidRun(Access, Begin, End, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+      {
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         const MIL_FLOAT* pValues = Access.Range[b] + Y * Access.RangePitch + X;
+         for(MIL_INT p = 0; p < Count; p++)
+            {
+            Box.Min[b] = std::min(Box.Min[b], pValues[p]);
+            Box.Max[b] = std::max(Box.Max[b], pValues[p]);
+            }
+         }
+      Box.NbPoints += Count;
+      });
+
+   return Box;
+   }
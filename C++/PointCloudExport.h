@@ -0,0 +1,633 @@
+﻿//***************************************************************************************/
+// 
+// File name: PointCloudExport.h
+//
+// Synopsis: Implementation of the chunked binary export of the aligned and merged point
+//           clouds. The points are written by parallel workers directly from the memory
+//           of the container, either in the binary PLY format or in a native tiled format
+//           whose tiles can be compressed and restored independently.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <array>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <limits>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+// Number of points handled by a worker at once. A chunk is also a tile of the tiled format.
+static const MIL_INT EXPORT_CHUNK_NB_POINTS = 65536;
+
+// Number of rows of a chunk of an organized point cloud. The chunks are blocks of the
+// grid, so that the points of a tile are close to each other in the world.
+static const MIL_INT EXPORT_CHUNK_SIZE_Y = 256;
+
+// Native tiled format.
+static const char       TILED_FORMAT_MAGIC[8] = {'M', 'I', 'L', 'T', 'I', 'L', 'E', 'D'};
+static const MIL_UINT32 TILED_FORMAT_VERSION  = 1;
+static const MIL_UINT32 TILED_FLAG_COLOR      = 0x1;
+static const MIL_UINT32 TILED_FLAG_COMPRESSED = 0x2;
+
+//****************************************************************************
+// Export formats.
+//****************************************************************************
+enum class EExportFormat
+   {
+   ePlyBinary,       // Binary little endian PLY.
+   eTiled,           // Native tiled format.
+   eTiledCompressed  // Native tiled format with compressed tiles.
+   };
+
+//****************************************************************************
+// Header and tile index entry of the native tiled format. The file is made of
+// the header, the index of all the tiles and the tile data. Each tile holds the
+// X, Y and Z planes of its points as 32-bit floats followed, if present, by the
+// R, G and B planes as 8-bit values.
+//****************************************************************************
+struct STiledFileHeader
+   {
+   char       Magic[8];
+   MIL_UINT32 Version;
+   MIL_UINT32 Flags;
+   MIL_UINT64 NbPoints;
+   MIL_UINT64 NbTiles;
+   };
+
+struct STiledFileTileEntry
+   {
+   MIL_FLOAT  Min[3];     // Bounding box of the points of the tile.
+   MIL_FLOAT  Max[3];
+   MIL_UINT64 NbPoints;
+   MIL_UINT64 Offset;     // Position of the tile data in the file.
+   MIL_UINT64 StoredSize; // Size of the tile data in the file.
+   };
+
+//****************************************************************************
+// Block of the grid of a point cloud exported as one chunk.
+//****************************************************************************
+struct SExportBlock
+   {
+   MIL_INT X;
+   MIL_INT Y;
+   MIL_INT SizeX;
+   MIL_INT SizeY;
+   };
+
+//****************************************************************************
+// Split the grid of a point cloud in blocks of about EXPORT_CHUNK_NB_POINTS
+// points. The blocks of an unorganized point cloud are ranges of its row.
+//****************************************************************************
+std::vector<SExportBlock> GetExportBlocks(const SPointCloudAccess& Access)
+   {
+   const MIL_INT BlockSizeY = std::max<MIL_INT>(1, std::min(Access.SizeY, EXPORT_CHUNK_SIZE_Y));
+   const MIL_INT BlockSizeX = std::max<MIL_INT>(1, EXPORT_CHUNK_NB_POINTS / BlockSizeY);
+   std::vector<SExportBlock> Blocks;
+   for(MIL_INT Y = 0; Y < Access.SizeY; Y += BlockSizeY)
+      {
+      for(MIL_INT X = 0; X < Access.SizeX; X += BlockSizeX)
+         Blocks.push_back({X, Y, std::min(BlockSizeX, Access.SizeX - X), std::min(BlockSizeY, Access.SizeY - Y)});
+      }
+   return Blocks;
+   }
+
+//****************************************************************************
+// Call the function on every run of consecutive valid points of a block, in
+// row-major order.
+//****************************************************************************
+template <class RunFunc>
+void ForEachValidRun(const SPointCloudAccess& Access, const SExportBlock& Block, RunFunc Func)
+   {
+   for(MIL_INT Y = Block.Y; Y < Block.Y + Block.SizeY; Y++)
+      ForEachValidRun(Access, Y * Access.SizeX + Block.X, Y * Access.SizeX + Block.X + Block.SizeX, Func);
+   }
+
+//****************************************************************************
+// Count the valid points of a chunk and compute their bounding box.
+//****************************************************************************
+STiledFileTileEntry AnalyzeChunk(const SPointCloudAccess& Access, MIL_INT Begin, MIL_INT End)
+   {
+   auto Box = GetValidPointsBox(Access, Begin, End);
+   STiledFileTileEntry Chunk = {};
+   Chunk.NbPoints = Box.NbPoints;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Chunk.Min[b] = Box.Min[b];
+      Chunk.Max[b] = Box.Max[b];
+      }
+   return Chunk;
+   }
+
+STiledFileTileEntry AnalyzeChunk(const SPointCloudAccess& Access, const SExportBlock& Block)
+   {
+   STiledFileTileEntry Chunk = AnalyzeChunk(Access, 0, 0);
+   for(MIL_INT Y = Block.Y; Y < Block.Y + Block.SizeY; Y++)
+      {
+      auto Row = AnalyzeChunk(Access, Y * Access.SizeX + Block.X, Y * Access.SizeX + Block.X + Block.SizeX);
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         Chunk.Min[b] = std::min(Chunk.Min[b], Row.Min[b]);
+         Chunk.Max[b] = std::max(Chunk.Max[b], Row.Max[b]);
+         }
+      Chunk.NbPoints += Row.NbPoints;
+      }
+   return Chunk;
+   }
+
+//****************************************************************************
+// Encode the zero runs of a byte stream. A control byte C < 128 is followed by
+// C + 1 literal bytes, a control byte C >= 128 stands for C - 127 zeros.
+//****************************************************************************
+void EncodeZeroRuns(const MIL_UINT8* pData, MIL_INT Size, std::vector<MIL_UINT8>& Encoded)
+   {
+   for(MIL_INT i = 0; i < Size;)
+      {
+      if(pData[i] == 0)
+         {
+         MIL_INT NbZeros = 1;
+         while(i + NbZeros < Size && NbZeros < 128 && pData[i + NbZeros] == 0)
+            NbZeros++;
+         Encoded.push_back(static_cast<MIL_UINT8>(127 + NbZeros));
+         i += NbZeros;
+         }
+      else
+         {
+         // Literals stop at the start of a run of at least two zeros.
+         MIL_INT NbLiterals = 1;
+         while(i + NbLiterals < Size && NbLiterals < 128 &&
+               !(pData[i + NbLiterals] == 0 && (i + NbLiterals + 1 == Size || pData[i + NbLiterals + 1] == 0)))
+            NbLiterals++;
+         Encoded.push_back(static_cast<MIL_UINT8>(NbLiterals - 1));
+         Encoded.insert(Encoded.end(), pData + i, pData + i + NbLiterals);
+         i += NbLiterals;
+         }
+      }
+   }
+
+//****************************************************************************
+// Decode a stream encoded with EncodeZeroRuns(). Returns false if the stream
+// does not decode to exactly Size bytes.
+//****************************************************************************
+bool DecodeZeroRuns(const MIL_UINT8* pEncoded, MIL_INT EncodedSize, MIL_UINT8* pData, MIL_INT Size)
+   {
+   MIL_INT Pos = 0;
+   for(MIL_INT i = 0; i < EncodedSize;)
+      {
+      MIL_UINT8 Control = pEncoded[i++];
+      if(Control < 128)
+         {
+         MIL_INT NbLiterals = Control + 1;
+         if(Pos + NbLiterals > Size || i + NbLiterals > EncodedSize)
+            return false;
+         memcpy(pData + Pos, pEncoded + i, NbLiterals);
+         i += NbLiterals;
+         Pos += NbLiterals;
+         }
+      else
+         {
+         MIL_INT NbZeros = Control - 127;
+         if(Pos + NbZeros > Size)
+            return false;
+         memset(pData + Pos, 0, NbZeros);
+         Pos += NbZeros;
+         }
+      }
+   return Pos == Size;
+   }
+
+//****************************************************************************
+// Compress the points of a chunk. Each value is XORed with the previous one of
+// its plane and split in byte planes so that the slowly varying high-order
+// bytes produce long zero runs.
+//****************************************************************************
+void CompressChunk(const SPointCloudAccess& Access, const SExportBlock& Block, MIL_INT NbPoints,
+                   std::vector<MIL_UINT8>& Planes, std::vector<MIL_UINT8>& Compressed)
+   {
+   const MIL_INT NbColorBands = Access.HasColor() ? 3 : 0;
+   Planes.resize(NbPoints * (3 * sizeof(MIL_FLOAT) + NbColorBands));
+   Compressed.clear();
+
+   MIL_UINT8* pPlane = Planes.data();
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      MIL_UINT32 Previous = 0;
+      MIL_INT n = 0;
+      ForEachValidRun(Access, Block, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+         {
+         const MIL_FLOAT* pValues = Access.Range[b] + Y * Access.RangePitch + X;
+         for(MIL_INT p = 0; p < Count; p++, n++)
+            {
+            MIL_UINT32 Bits;
+            memcpy(&Bits, pValues + p, sizeof(Bits));
+            MIL_UINT32 Delta = Bits ^ Previous;
+            Previous = Bits;
+            for(MIL_INT k = 0; k < 4; k++)
+               pPlane[k * NbPoints + n] = static_cast<MIL_UINT8>(Delta >> (8 * k));
+            }
+         });
+      pPlane += 4 * NbPoints;
+      }
+
+   for(MIL_INT b = 0; b < NbColorBands; b++)
+      {
+      MIL_UINT8 Previous = 0;
+      MIL_INT n = 0;
+      ForEachValidRun(Access, Block, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+         {
+         const MIL_UINT8* pValues = Access.Color[b] + Y * Access.ColorPitch + X;
+         for(MIL_INT p = 0; p < Count; p++, n++)
+            {
+            pPlane[n] = pValues[p] ^ Previous;
+            Previous = pValues[p];
+            }
+         });
+      pPlane += NbPoints;
+      }
+
+   EncodeZeroRuns(Planes.data(), static_cast<MIL_INT>(Planes.size()), Compressed);
+   }
+
+//****************************************************************************
+// Decompress a chunk directly in the point arrays of the destination.
+//****************************************************************************
+bool DecompressChunk(const std::vector<MIL_UINT8>& Compressed, MIL_INT NbPoints, bool HasColor,
+                     std::array<MIL_FLOAT*, 3> Range, std::array<MIL_UINT8*, 3> Color,
+                     std::vector<MIL_UINT8>& Planes)
+   {
+   const MIL_INT NbColorBands = HasColor ? 3 : 0;
+   Planes.resize(NbPoints * (3 * sizeof(MIL_FLOAT) + NbColorBands));
+   if(!DecodeZeroRuns(Compressed.data(), static_cast<MIL_INT>(Compressed.size()), Planes.data(), static_cast<MIL_INT>(Planes.size())))
+      return false;
+
+   const MIL_UINT8* pPlane = Planes.data();
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      MIL_UINT32 Previous = 0;
+      for(MIL_INT n = 0; n < NbPoints; n++)
+         {
+         MIL_UINT32 Delta = 0;
+         for(MIL_INT k = 0; k < 4; k++)
+            Delta |= static_cast<MIL_UINT32>(pPlane[k * NbPoints + n]) << (8 * k);
+         Previous ^= Delta;
+         memcpy(Range[b] + n, &Previous, sizeof(Previous));
+         }
+      pPlane += 4 * NbPoints;
+      }
+
+   for(MIL_INT b = 0; b < NbColorBands; b++)
+      {
+      MIL_UINT8 Previous = 0;
+      for(MIL_INT n = 0; n < NbPoints; n++)
+         {
+         Previous ^= pPlane[n];
+         Color[b][n] = Previous;
+         }
+      pPlane += NbPoints;
+      }
+   return true;
+   }
+
+//****************************************************************************
+// Write the valid points of a chunk as PLY vertices.
+//****************************************************************************
+void FillPlyRecords(const SPointCloudAccess& Access, const SExportBlock& Block, std::vector<char>& Records)
+   {
+   const MIL_INT RecordSize = 3 * sizeof(MIL_FLOAT) + (Access.HasColor() ? 3 : 0);
+   char* pRecord = Records.data();
+   ForEachValidRun(Access, Block, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+      {
+      MIL_INT RangeIdx = Y * Access.RangePitch + X;
+      MIL_INT ColorIdx = Y * Access.ColorPitch + X;
+      for(MIL_INT p = 0; p < Count; p++, pRecord += RecordSize)
+         {
+         for(MIL_INT b = 0; b < 3; b++)
+            memcpy(pRecord + b * sizeof(MIL_FLOAT), Access.Range[b] + RangeIdx + p, sizeof(MIL_FLOAT));
+         if(Access.HasColor())
+            {
+            for(MIL_INT b = 0; b < 3; b++)
+               pRecord[3 * sizeof(MIL_FLOAT) + b] = static_cast<char>(Access.Color[b][ColorIdx + p]);
+            }
+         }
+      });
+   }
+
+//****************************************************************************
+// Allocate the file to its final size so that the workers can write their
+// chunks at any position.
+//****************************************************************************
+bool PreallocateFile(const MIL_STRING& FileName, const std::string& Header, MIL_UINT64 FileSize)
+   {
+   std::ofstream File(FileName, std::ios::binary | std::ios::trunc);
+   File.write(Header.data(), Header.size());
+   if(FileSize > Header.size())
+      {
+      File.seekp(static_cast<std::streamoff>(FileSize - 1));
+      File.put('\0');
+      }
+   return File.good();
+   }
+
+//****************************************************************************
+// Export the points of an access in the binary PLY or native tiled format.
+// The valid points are split in chunks that are written in parallel.
+//****************************************************************************
+bool ExportPointCloud(const SPointCloudAccess& Access, const MIL_STRING& FileName, EExportFormat Format,
+                      MIL_INT NbWorkers, MIL_UINT64* pNbBytesWritten = nullptr)
+   {
+   // Analyze the chunks to get the position of each one in the file.
+   const auto Blocks = GetExportBlocks(Access);
+   const MIL_INT NbChunks = static_cast<MIL_INT>(Blocks.size());
+   std::vector<STiledFileTileEntry> Chunks(NbChunks);
+   ParallelForEachTask(NbChunks, NbWorkers, [&](MIL_INT c, MIL_INT)
+      {
+      Chunks[c] = AnalyzeChunk(Access, Blocks[c]);
+      });
+
+   MIL_UINT64 NbPoints = 0;
+   for(const auto& Chunk : Chunks)
+      NbPoints += Chunk.NbPoints;
+
+   const bool HasColor = Access.HasColor();
+   const bool IsPly = (Format == EExportFormat::ePlyBinary);
+   const bool IsCompressed = (Format == EExportFormat::eTiledCompressed);
+   const MIL_UINT64 PointSize = 3 * sizeof(MIL_FLOAT) + (HasColor ? 3 : 0);
+
+   // Build the header.
+   std::string Header;
+   STiledFileHeader TiledHeader = {};
+   if(IsPly)
+      {
+      Header = "ply\nformat binary_little_endian 1.0\nelement vertex " + std::to_string(NbPoints) + "\n"
+               "property float x\nproperty float y\nproperty float z\n";
+      if(HasColor)
+         Header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+      Header += "end_header\n";
+      }
+   else
+      {
+      memcpy(TiledHeader.Magic, TILED_FORMAT_MAGIC, sizeof(TiledHeader.Magic));
+      TiledHeader.Version = TILED_FORMAT_VERSION;
+      TiledHeader.Flags = (HasColor ? TILED_FLAG_COLOR : 0) | (IsCompressed ? TILED_FLAG_COMPRESSED : 0);
+      TiledHeader.NbPoints = NbPoints;
+      TiledHeader.NbTiles = NbChunks;
+      Header.assign(reinterpret_cast<const char*>(&TiledHeader), sizeof(TiledHeader));
+      Header.append(NbChunks * sizeof(STiledFileTileEntry), '\0');
+      }
+
+   // Place the chunks one after the other. The compressed chunks are placed
+   // as they are produced since their size is only known then.
+   MIL_UINT64 FileSize = Header.size();
+   if(!IsCompressed)
+      {
+      for(auto& Chunk : Chunks)
+         {
+         Chunk.Offset = FileSize;
+         Chunk.StoredSize = Chunk.NbPoints * PointSize;
+         FileSize += Chunk.StoredSize;
+         }
+      }
+   if(!PreallocateFile(FileName, Header, IsCompressed ? 0 : FileSize))
+      {
+      MosPrintf(MIL_TEXT("Unable to create the file %s.\n\n"), FileName.c_str());
+      return false;
+      }
+
+   // Write the chunks.
+   std::atomic<bool> Success(true);
+   std::atomic<MIL_UINT64> NextOffset(FileSize);
+   std::vector<std::fstream> Files(NbWorkers);
+   std::vector<std::vector<char>> Records(NbWorkers);
+   std::vector<std::vector<MIL_UINT8>> Planes(NbWorkers);
+   std::vector<std::vector<MIL_UINT8>> Compressed(NbWorkers);
+   ParallelForEachTask(NbChunks, NbWorkers, [&](MIL_INT c, MIL_INT w)
+      {
+      auto& Chunk = Chunks[c];
+      if(Chunk.NbPoints == 0)
+         return;
+
+      const auto& Block = Blocks[c];
+      auto& File = Files[w];
+      if(!File.is_open())
+         File.open(FileName, std::ios::binary | std::ios::in | std::ios::out);
+
+      if(IsPly)
+         {
+         Records[w].resize(Chunk.StoredSize);
+         FillPlyRecords(Access, Block, Records[w]);
+         File.seekp(static_cast<std::streamoff>(Chunk.Offset));
+         File.write(Records[w].data(), Records[w].size());
+         }
+      else if(IsCompressed)
+         {
+         CompressChunk(Access, Block, static_cast<MIL_INT>(Chunk.NbPoints), Planes[w], Compressed[w]);
+         Chunk.StoredSize = Compressed[w].size();
+         Chunk.Offset = NextOffset.fetch_add(Chunk.StoredSize);
+         File.seekp(static_cast<std::streamoff>(Chunk.Offset));
+         File.write(reinterpret_cast<const char*>(Compressed[w].data()), Compressed[w].size());
+         }
+      else
+         {
+         // The planes are written straight from the memory of the components.
+         File.seekp(static_cast<std::streamoff>(Chunk.Offset));
+         for(MIL_INT b = 0; b < 3; b++)
+            {
+            ForEachValidRun(Access, Block, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+               {
+               File.write(reinterpret_cast<const char*>(Access.Range[b] + Y * Access.RangePitch + X), Count * sizeof(MIL_FLOAT));
+               });
+            }
+         for(MIL_INT b = 0; b < (HasColor ? 3 : 0); b++)
+            {
+            ForEachValidRun(Access, Block, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+               {
+               File.write(reinterpret_cast<const char*>(Access.Color[b] + Y * Access.ColorPitch + X), Count);
+               });
+            }
+         }
+
+      if(!File.good())
+         Success = false;
+      });
+
+   for(auto& File : Files)
+      {
+      if(File.is_open())
+         {
+         File.close();
+         if(File.fail())
+            Success = false;
+         }
+      }
+
+   // Write the tile index.
+   if(!IsPly && Success)
+      {
+      std::fstream File(FileName, std::ios::binary | std::ios::in | std::ios::out);
+      File.seekp(sizeof(STiledFileHeader));
+      File.write(reinterpret_cast<const char*>(Chunks.data()), Chunks.size() * sizeof(STiledFileTileEntry));
+      Success = Success && File.good();
+      }
+
+   if(!Success)
+      {
+      MosPrintf(MIL_TEXT("An error occurred while writing the file %s.\n\n"), FileName.c_str());
+      return false;
+      }
+
+   if(pNbBytesWritten)
+      *pNbBytesWritten = IsCompressed ? NextOffset.load() : FileSize;
+   return true;
+   }
+
+//****************************************************************************
+// Export a point cloud in the binary PLY or native tiled format.
+//****************************************************************************
+bool ExportPointCloud(MIL_ID MilPointCloud, const MIL_STRING& FileName, EExportFormat Format,
+                      MIL_UINT64* pNbBytesWritten = nullptr, const SValidityIndex* pValidity = nullptr)
+   {
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return false;
+   SetValidityIndex(Access, pValidity);
+
+   return ExportPointCloud(Access, FileName, Format, GetNbWorkers(), pNbBytesWritten);
+   }
+
+//****************************************************************************
+// Restore the tiles of a native tiled file that intersect the given box. All
+// the points of the intersecting tiles are restored. The index is checked
+// against the size of the file before anything is allocated.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID RestoreTiledPointCloud(MIL_ID MilSystem, const MIL_STRING& FileName,
+                                         MIL_DOUBLE MinX, MIL_DOUBLE MinY, MIL_DOUBLE MinZ,
+                                         MIL_DOUBLE MaxX, MIL_DOUBLE MaxY, MIL_DOUBLE MaxZ)
+   {
+   std::ifstream File(FileName, std::ios::binary | std::ios::ate);
+   const MIL_UINT64 FileSize = File.good() ? static_cast<MIL_UINT64>(File.tellg()) : 0;
+   File.seekg(0);
+   STiledFileHeader Header = {};
+   File.read(reinterpret_cast<char*>(&Header), sizeof(Header));
+   if(!File.good() || memcmp(Header.Magic, TILED_FORMAT_MAGIC, sizeof(Header.Magic)) != 0 || Header.Version != TILED_FORMAT_VERSION)
+      {
+      MosPrintf(MIL_TEXT("The file %s is not a valid tiled point cloud file.\n\n"), FileName.c_str());
+      return MIL_UNIQUE_BUF_ID();
+      }
+
+   // The tile index must fit in the file and each tile must fit after it.
+   if(Header.NbTiles > (FileSize - sizeof(STiledFileHeader)) / sizeof(STiledFileTileEntry))
+      {
+      MosPrintf(MIL_TEXT("The file %s is corrupted.\n\n"), FileName.c_str());
+      return MIL_UNIQUE_BUF_ID();
+      }
+   std::vector<STiledFileTileEntry> Tiles(static_cast<size_t>(Header.NbTiles));
+   File.read(reinterpret_cast<char*>(Tiles.data()), Tiles.size() * sizeof(STiledFileTileEntry));
+
+   const bool HasColor = (Header.Flags & TILED_FLAG_COLOR) != 0;
+   const MIL_UINT64 PointSize = 3 * sizeof(MIL_FLOAT) + (HasColor ? 3 : 0);
+   const MIL_UINT64 DataBegin = sizeof(STiledFileHeader) + Tiles.size() * sizeof(STiledFileTileEntry);
+   bool IsIndexValid = File.good();
+   for(const auto& Tile : Tiles)
+      {
+      if(Tile.NbPoints == 0)
+         continue;
+      IsIndexValid = IsIndexValid && Tile.NbPoints <= static_cast<MIL_UINT64>(EXPORT_CHUNK_NB_POINTS) &&
+                     Tile.Offset >= DataBegin && Tile.Offset <= FileSize && Tile.StoredSize <= FileSize - Tile.Offset &&
+                     ((Header.Flags & TILED_FLAG_COMPRESSED) || Tile.StoredSize == Tile.NbPoints * PointSize);
+      }
+   if(!IsIndexValid)
+      {
+      MosPrintf(MIL_TEXT("The file %s is corrupted.\n\n"), FileName.c_str());
+      return MIL_UNIQUE_BUF_ID();
+      }
+
+   // Select the tiles that intersect the box.
+   const MIL_DOUBLE BoxMin[3] = {MinX, MinY, MinZ};
+   const MIL_DOUBLE BoxMax[3] = {MaxX, MaxY, MaxZ};
+   std::vector<MIL_INT> SelectedTiles;
+   MIL_INT NbPoints = 0;
+   for(MIL_INT t = 0; t < static_cast<MIL_INT>(Tiles.size()); t++)
+      {
+      bool Intersects = Tiles[t].NbPoints > 0;
+      for(MIL_INT b = 0; b < 3; b++)
+         Intersects = Intersects && Tiles[t].Max[b] >= BoxMin[b] && Tiles[t].Min[b] <= BoxMax[b];
+      if(Intersects)
+         {
+         SelectedTiles.push_back(t);
+         NbPoints += static_cast<MIL_INT>(Tiles[t].NbPoints);
+         }
+      }
+
+   auto MilPointCloud = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   if(NbPoints == 0)
+      return MilPointCloud;
+
+   // Allocate the components and decode the tiles directly in them.
+   MbufAllocComponent(MilPointCloud, 3, NbPoints, 1, 32 + M_FLOAT, M_IMAGE + M_PLANAR, M_COMPONENT_RANGE, M_NULL);
+   if(HasColor)
+      MbufAllocComponent(MilPointCloud, 3, NbPoints, 1, 8 + M_UNSIGNED, M_IMAGE + M_PLANAR, M_COMPONENT_REFLECTANCE, M_NULL);
+   auto Access = AccessPointCloud(MilPointCloud);
+
+   std::vector<MIL_UINT8> Stored, Planes;
+   MIL_INT FirstPoint = 0;
+   for(auto t : SelectedTiles)
+      {
+      const auto& Tile = Tiles[t];
+      const MIL_INT TileNbPoints = static_cast<MIL_INT>(Tile.NbPoints);
+      std::array<MIL_FLOAT*, 3> Range;
+      std::array<MIL_UINT8*, 3> Color = {};
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         Range[b] = Access.Range[b] + FirstPoint;
+         if(HasColor)
+            Color[b] = Access.Color[b] + FirstPoint;
+         }
+
+      File.seekg(static_cast<std::streamoff>(Tile.Offset));
+      if(Header.Flags & TILED_FLAG_COMPRESSED)
+         {
+         Stored.resize(Tile.StoredSize);
+         File.read(reinterpret_cast<char*>(Stored.data()), Stored.size());
+         if(!File.good() || !DecompressChunk(Stored, TileNbPoints, HasColor, Range, Color, Planes))
+            break;
+         }
+      else
+         {
+         for(MIL_INT b = 0; b < 3; b++)
+            File.read(reinterpret_cast<char*>(Range[b]), TileNbPoints * sizeof(MIL_FLOAT));
+         for(MIL_INT b = 0; b < (HasColor ? 3 : 0); b++)
+            File.read(reinterpret_cast<char*>(Color[b]), TileNbPoints);
+         }
+
+      if(!File.good())
+         break;
+      FirstPoint += TileNbPoints;
+      }
+
+   if(FirstPoint != NbPoints)
+      {
+      MosPrintf(MIL_TEXT("The file %s is corrupted.\n\n"), FileName.c_str());
+      return MIL_UNIQUE_BUF_ID();
+      }
+
+   return MilPointCloud;
+   }
+
+//****************************************************************************
+// Restore all the tiles of a native tiled file.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID RestoreTiledPointCloud(MIL_ID MilSystem, const MIL_STRING& FileName)
+   {
+   const MIL_DOUBLE Inf = std::numeric_limits<MIL_DOUBLE>::infinity();
+   return RestoreTiledPointCloud(MilSystem, FileName, -Inf, -Inf, -Inf, Inf, Inf, Inf);
+   }
+
+//****************************************************************************
+// Get the file extension of an export format.
+//****************************************************************************
+MIL_STRING GetExportFileExtension(EExportFormat Format)
+   {
+   return Format == EExportFormat::ePlyBinary ? MIL_TEXT(".ply") : MIL_TEXT(".mtiled");
+   }
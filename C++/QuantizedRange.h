@@ -0,0 +1,503 @@
+﻿//***************************************************************************************/
+// 
+// File name: QuantizedRange.h
+//
+// Synopsis: Implementation of a 16-bit quantized representation of the range of the
+//           point clouds, with a scale and an offset per axis. The point clouds are
+//           transformed and merged directly in the quantized representation and are
+//           only dequantized when exported.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QUANTIZED_USE_SSE2 1
+#endif
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+static const MIL_INT16  QUANTIZED_INVALID   = -32768;  // Marks the invalid points.
+static const MIL_DOUBLE QUANTIZED_MAX_LEVEL = 32767.0;
+static const MIL_DOUBLE QUANTIZED_MIN_SCALE = 1.0e-6;
+static const MIL_INT    QUANTIZED_CONTAINER_SIZE_X = 4096; // Row size of the containers of merged points.
+
+//****************************************************************************
+// Quantization of an axis: Value = Offset + Scale * Level.
+//****************************************************************************
+struct SQuantizedAxis
+   {
+   MIL_DOUBLE Scale  = 1.0;
+   MIL_DOUBLE Offset = 0.0;
+   };
+
+//****************************************************************************
+// Point cloud with a 16-bit quantized range, in planes.
+//****************************************************************************
+struct SQuantizedPointCloud
+   {
+   MIL_INT SizeX = 0;
+   MIL_INT SizeY = 0;
+   std::array<SQuantizedAxis, 3>         Axes;
+   std::array<std::vector<MIL_INT16>, 3> Range;
+   std::array<std::vector<MIL_UINT8>, 3> Color;
+   SValidityIndex                        Validity;
+
+   bool HasColor() const { return !Color[0].empty(); }
+   MIL_INT NbPoints() const { return SizeX * SizeY; }
+   MIL_UINT64 NbBytes() const { return NbPoints() * (3 * sizeof(MIL_INT16) + (HasColor() ? 3 : 0)); }
+   };
+
+//****************************************************************************
+// Get the quantization of the axes that covers a bounding box.
+//****************************************************************************
+std::array<SQuantizedAxis, 3> GetQuantizedAxes(const MIL_DOUBLE Min[3], const MIL_DOUBLE Max[3])
+   {
+   std::array<SQuantizedAxis, 3> Axes;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Axes[b].Offset = 0.5 * (Min[b] + Max[b]);
+      Axes[b].Scale = std::max(QUANTIZED_MIN_SCALE, 0.5 * (Max[b] - Min[b]) / QUANTIZED_MAX_LEVEL);
+      }
+   return Axes;
+   }
+
+//****************************************************************************
+// Get the affine transformation, from the levels of the source to the levels
+// of the destination, of a 4x4 transformation matrix:
+//   DstLevel[r] = Affine[4r] * X + Affine[4r+1] * Y + Affine[4r+2] * Z + Affine[4r+3].
+//****************************************************************************
+std::array<MIL_FLOAT, 12> GetQuantizedAffine(const MIL_DOUBLE Matrix[16], const std::array<SQuantizedAxis, 3>& SrcAxes,
+                                             const std::array<SQuantizedAxis, 3>& DstAxes)
+   {
+   std::array<MIL_FLOAT, 12> Affine;
+   for(MIL_INT r = 0; r < 3; r++)
+      {
+      MIL_DOUBLE Translation = Matrix[4 * r + 3];
+      for(MIL_INT c = 0; c < 3; c++)
+         {
+         Affine[4 * r + c] = static_cast<MIL_FLOAT>(Matrix[4 * r + c] * SrcAxes[c].Scale / DstAxes[r].Scale);
+         Translation += Matrix[4 * r + c] * SrcAxes[c].Offset;
+         }
+      Affine[4 * r + 3] = static_cast<MIL_FLOAT>((Translation - DstAxes[r].Offset) / DstAxes[r].Scale);
+      }
+   return Affine;
+   }
+
+//****************************************************************************
+// Transform quantized points directly from the source levels to the
+// destination levels. The levels are saturated to the valid range.
+//****************************************************************************
+void TransformQuantizedPoints(const MIL_INT16* const pSrc[3], MIL_INT NbPoints, const std::array<MIL_FLOAT, 12>& Affine,
+                              MIL_INT16* const pDst[3])
+   {
+   MIL_INT i = 0;
+#if QUANTIZED_USE_SSE2
+   const __m128 MaxLevel = _mm_set1_ps(static_cast<MIL_FLOAT>(QUANTIZED_MAX_LEVEL));
+   const __m128 MinLevel = _mm_set1_ps(static_cast<MIL_FLOAT>(-QUANTIZED_MAX_LEVEL));
+   for(; i + 8 <= NbPoints; i += 8)
+      {
+      // Sign extend the 8 levels of each axis to two vectors of 4 floats.
+      __m128 Lo[3], Hi[3];
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         __m128i Levels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc[b] + i));
+         Lo[b] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(Levels, Levels), 16));
+         Hi[b] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(Levels, Levels), 16));
+         }
+
+      for(MIL_INT r = 0; r < 3; r++)
+         {
+         const __m128 A0 = _mm_set1_ps(Affine[4 * r]);
+         const __m128 A1 = _mm_set1_ps(Affine[4 * r + 1]);
+         const __m128 A2 = _mm_set1_ps(Affine[4 * r + 2]);
+         const __m128 A3 = _mm_set1_ps(Affine[4 * r + 3]);
+         __m128 OutLo = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A0, Lo[0]), _mm_mul_ps(A1, Lo[1])), _mm_add_ps(_mm_mul_ps(A2, Lo[2]), A3));
+         __m128 OutHi = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A0, Hi[0]), _mm_mul_ps(A1, Hi[1])), _mm_add_ps(_mm_mul_ps(A2, Hi[2]), A3));
+         OutLo = _mm_min_ps(_mm_max_ps(OutLo, MinLevel), MaxLevel);
+         OutHi = _mm_min_ps(_mm_max_ps(OutHi, MinLevel), MaxLevel);
+         __m128i Out = _mm_packs_epi32(_mm_cvtps_epi32(OutLo), _mm_cvtps_epi32(OutHi));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst[r] + i), Out);
+         }
+      }
+#endif
+
+   for(; i < NbPoints; i++)
+      {
+      for(MIL_INT r = 0; r < 3; r++)
+         {
+         MIL_FLOAT Level = Affine[4 * r] * pSrc[0][i] + Affine[4 * r + 1] * pSrc[1][i] + Affine[4 * r + 2] * pSrc[2][i] + Affine[4 * r + 3];
+         Level = std::min(std::max(Level, static_cast<MIL_FLOAT>(-QUANTIZED_MAX_LEVEL)), static_cast<MIL_FLOAT>(QUANTIZED_MAX_LEVEL));
+         pDst[r][i] = static_cast<MIL_INT16>(std::nearbyint(Level));
+         }
+      }
+   }
+
+//****************************************************************************
+// Quantize the range of an organized point cloud. The quantization covers the
+// bounding box of the valid points; the invalid points are marked in Z. The
+// validity index is kept with the quantized point cloud, and built if it is
+// not given.
+//****************************************************************************
+SQuantizedPointCloud QuantizePointCloud(MIL_ID MilPointCloud, const SValidityIndex* pValidity = nullptr)
+   {
+   SQuantizedPointCloud Quantized;
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return Quantized;
+   SetValidityIndex(Access, pValidity);
+   Quantized.Validity = Access.pValidity ? *Access.pValidity : BuildValidityIndex(Access);
+   Access.pValidity = &Quantized.Validity;
+
+   auto Box = GetValidPointsBox(Access, 0, Access.NbPoints());
+   if(Box.NbPoints == 0)
+      return Quantized;
+   MIL_DOUBLE Min[3], Max[3];
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Min[b] = Box.Min[b];
+      Max[b] = Box.Max[b];
+      }
+
+   Quantized.SizeX = Access.SizeX;
+   Quantized.SizeY = Access.SizeY;
+   Quantized.Axes = GetQuantizedAxes(Min, Max);
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Quantized.Range[b].assign(Access.NbPoints(), 0);
+      if(Access.HasColor())
+         Quantized.Color[b].resize(Access.NbPoints());
+      }
+   Quantized.Range[2].assign(Access.NbPoints(), QUANTIZED_INVALID);
+
+   ParallelForEachTask(Access.SizeY, GetNbWorkers(), [&](MIL_INT y, MIL_INT)
+      {
+      ForEachValidRun(Access, y * Access.SizeX, (y + 1) * Access.SizeX, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+         {
+         for(MIL_INT b = 0; b < 3; b++)
+            {
+            const MIL_FLOAT* pValues = Access.Range[b] + Y * Access.RangePitch + X;
+            MIL_INT16* pLevels = Quantized.Range[b].data() + Y * Quantized.SizeX + X;
+            const MIL_DOUBLE InvScale = 1.0 / Quantized.Axes[b].Scale;
+            for(MIL_INT p = 0; p < Count; p++)
+               pLevels[p] = static_cast<MIL_INT16>(std::nearbyint((pValues[p] - Quantized.Axes[b].Offset) * InvScale));
+            if(Access.HasColor())
+               memcpy(Quantized.Color[b].data() + Y * Quantized.SizeX + X, Access.Color[b] + Y * Access.ColorPitch + X, Count);
+            }
+         });
+      });
+
+   return Quantized;
+   }
+
+//****************************************************************************
+// Get the bounding box of a quantized point cloud once transformed. The
+// corners of the quantization box are transformed, which is conservative.
+//****************************************************************************
+void GetTransformedQuantizedBox(const SQuantizedPointCloud& Quantized, const MIL_DOUBLE Matrix[16], MIL_DOUBLE Min[3], MIL_DOUBLE Max[3])
+   {
+   for(MIL_INT Corner = 0; Corner < 8; Corner++)
+      {
+      MIL_DOUBLE P[3];
+      for(MIL_INT b = 0; b < 3; b++)
+         P[b] = Quantized.Axes[b].Offset + ((Corner >> b) & 1 ? 1.0 : -1.0) * QUANTIZED_MAX_LEVEL * Quantized.Axes[b].Scale;
+      for(MIL_INT r = 0; r < 3; r++)
+         {
+         MIL_DOUBLE Value = Matrix[4 * r] * P[0] + Matrix[4 * r + 1] * P[1] + Matrix[4 * r + 2] * P[2] + Matrix[4 * r + 3];
+         Min[r] = std::min(Min[r], Value);
+         Max[r] = std::max(Max[r], Value);
+         }
+      }
+   }
+
+//****************************************************************************
+// Maximum error, in levels of the destination, of the quantized transform.
+//****************************************************************************
+struct SQuantizedTransformCheck
+   {
+   MIL_INT    NbPoints = 0;
+   MIL_DOUBLE MaxLevelError[3] = {0.0, 0.0, 0.0};
+
+   bool IsWithinOneLevel() const { return std::max({MaxLevelError[0], MaxLevelError[1], MaxLevelError[2]}) <= 1.0; }
+   };
+
+//****************************************************************************
+// Check the transform of a quantized point cloud against M3dimMatrixTransform
+// of the point cloud it was quantized from. The destination levels are those
+// of the transformed box of the point cloud alone, which are finer than those
+// of a merge. The point cloud is transformed in place.
+//****************************************************************************
+SQuantizedTransformCheck CheckQuantizedTransform(MIL_ID MilPointCloud, const SQuantizedPointCloud& Quantized, MIL_ID MilMatrix)
+   {
+   SQuantizedTransformCheck Check;
+   if(Quantized.NbPoints() == 0)
+      return Check;
+
+   std::array<MIL_DOUBLE, 16> Matrix;
+   M3dgeoMatrixGet(MilMatrix, M_DEFAULT, Matrix.data());
+   MIL_DOUBLE Min[3], Max[3];
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Min[b] = std::numeric_limits<MIL_DOUBLE>::max();
+      Max[b] = std::numeric_limits<MIL_DOUBLE>::lowest();
+      }
+   GetTransformedQuantizedBox(Quantized, Matrix.data(), Min, Max);
+   const auto DstAxes = GetQuantizedAxes(Min, Max);
+   const auto Affine = GetQuantizedAffine(Matrix.data(), Quantized.Axes, DstAxes);
+
+   M3dimMatrixTransform(MilPointCloud, MilPointCloud, MilMatrix, M_DEFAULT);
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid || Access.SizeX != Quantized.SizeX || Access.SizeY != Quantized.SizeY)
+      return Check;
+   Access.pValidity = &Quantized.Validity;
+
+   const MIL_INT NbWorkers = GetNbWorkers();
+   std::vector<SQuantizedTransformCheck> WorkerChecks(NbWorkers);
+   ParallelForEachTask(Access.SizeY, NbWorkers, [&](MIL_INT y, MIL_INT Worker)
+      {
+      auto& WorkerCheck = WorkerChecks[Worker];
+      std::array<std::vector<MIL_INT16>, 3> Levels;
+      ForEachValidRun(Access, y * Access.SizeX, (y + 1) * Access.SizeX, [&](MIL_INT X, MIL_INT Y, MIL_INT Count)
+         {
+         const MIL_INT16* pSrc[3];
+         MIL_INT16* pDst[3];
+         for(MIL_INT b = 0; b < 3; b++)
+            {
+            Levels[b].resize(Count);
+            pSrc[b] = Quantized.Range[b].data() + Y * Quantized.SizeX + X;
+            pDst[b] = Levels[b].data();
+            }
+         TransformQuantizedPoints(pSrc, Count, Affine, pDst);
+
+         for(MIL_INT r = 0; r < 3; r++)
+            {
+            const MIL_FLOAT* pValues = Access.Range[r] + Y * Access.RangePitch + X;
+            for(MIL_INT p = 0; p < Count; p++)
+               {
+               MIL_DOUBLE Level = (pValues[p] - DstAxes[r].Offset) / DstAxes[r].Scale;
+               WorkerCheck.MaxLevelError[r] = std::max(WorkerCheck.MaxLevelError[r], std::abs(Level - Levels[r][p]));
+               }
+            }
+         WorkerCheck.NbPoints += Count;
+         });
+      });
+
+   for(const auto& WorkerCheck : WorkerChecks)
+      {
+      Check.NbPoints += WorkerCheck.NbPoints;
+      for(MIL_INT r = 0; r < 3; r++)
+         Check.MaxLevelError[r] = std::max(Check.MaxLevelError[r], WorkerCheck.MaxLevelError[r]);
+      }
+   return Check;
+   }
+
+//****************************************************************************
+// Call the function on the runs of valid points of a row, with their first
+// point aligned on the decimation step: Func(FirstX, EndX).
+//****************************************************************************
+template <class RunFunc>
+void ForEachKeptRun(const SQuantizedPointCloud& Quantized, MIL_INT Y, MIL_INT DecimationStep, RunFunc Func)
+   {
+   Quantized.Validity.ForEachRun(Y * Quantized.SizeX, (Y + 1) * Quantized.SizeX, [&](MIL_INT X, MIL_INT, MIL_INT Count)
+      {
+      MIL_INT FirstX = ((X + DecimationStep - 1) / DecimationStep) * DecimationStep;
+      if(FirstX < X + Count)
+         Func(FirstX, X + Count);
+      });
+   }
+
+//****************************************************************************
+// Transform and merge quantized point clouds, with the same decimation as the
+// merge of the containers. The merged point cloud is a list of the valid
+// points, quantized over the union of the transformed boxes.
+//****************************************************************************
+SQuantizedPointCloud MergeQuantizedPointClouds(const std::vector<const SQuantizedPointCloud*>& PointClouds,
+                                               const std::vector<MIL_ID>& MilMatrices, MIL_INT DecimationStep)
+   {
+   SQuantizedPointCloud Merged;
+   DecimationStep = std::max<MIL_INT>(1, DecimationStep);
+
+   // Quantize the merged point cloud over the transformed boxes.
+   std::vector<std::array<MIL_DOUBLE, 16>> Matrices(PointClouds.size());
+   MIL_DOUBLE Min[3], Max[3];
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Min[b] = std::numeric_limits<MIL_DOUBLE>::max();
+      Max[b] = std::numeric_limits<MIL_DOUBLE>::lowest();
+      }
+   bool HasColor = !PointClouds.empty();
+   for(size_t c = 0; c < PointClouds.size(); c++)
+      {
+      M3dgeoMatrixGet(MilMatrices[c], M_DEFAULT, Matrices[c].data());
+      GetTransformedQuantizedBox(*PointClouds[c], Matrices[c].data(), Min, Max);
+      HasColor = HasColor && PointClouds[c]->HasColor();
+      }
+   if(PointClouds.empty())
+      return Merged;
+   Merged.Axes = GetQuantizedAxes(Min, Max);
+
+   // Count the kept points of each row to place the rows in the merged point cloud.
+   struct SRow
+      {
+      MIL_INT Cloud;
+      MIL_INT Y;
+      MIL_INT DstOffset;
+      };
+   std::vector<SRow> Rows;
+   for(MIL_INT c = 0; c < (MIL_INT)PointClouds.size(); c++)
+      {
+      for(MIL_INT y = 0; y < PointClouds[c]->SizeY; y += DecimationStep)
+         Rows.push_back({c, y, 0});
+      }
+   std::vector<MIL_INT> NbRowPoints(Rows.size(), 0);
+   ParallelForEachTask((MIL_INT)Rows.size(), GetNbWorkers(), [&](MIL_INT r, MIL_INT)
+      {
+      const auto& Cloud = *PointClouds[Rows[r].Cloud];
+      ForEachKeptRun(Cloud, Rows[r].Y, DecimationStep, [&](MIL_INT FirstX, MIL_INT EndX)
+         {
+         NbRowPoints[r] += (EndX - FirstX + DecimationStep - 1) / DecimationStep;
+         });
+      });
+   MIL_INT NbPoints = 0;
+   for(size_t r = 0; r < Rows.size(); r++)
+      {
+      Rows[r].DstOffset = NbPoints;
+      NbPoints += NbRowPoints[r];
+      }
+
+   Merged.SizeX = NbPoints;
+   Merged.SizeY = 1;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Merged.Range[b].resize(NbPoints);
+      if(HasColor)
+         Merged.Color[b].resize(NbPoints);
+      }
+
+   // Gather the kept points of each row and transform them in the merged point cloud.
+   std::vector<std::array<MIL_FLOAT, 12>> Affines;
+   for(size_t c = 0; c < PointClouds.size(); c++)
+      Affines.push_back(GetQuantizedAffine(Matrices[c].data(), PointClouds[c]->Axes, Merged.Axes));
+
+   ParallelForEachTask((MIL_INT)Rows.size(), GetNbWorkers(), [&](MIL_INT r, MIL_INT)
+      {
+      const auto& Cloud = *PointClouds[Rows[r].Cloud];
+      std::array<std::vector<MIL_INT16>, 3> Gathered;
+      for(MIL_INT b = 0; b < 3; b++)
+         Gathered[b].reserve(NbRowPoints[r]);
+
+      const MIL_INT RowOffset = Rows[r].Y * Cloud.SizeX;
+      MIL_INT DstIdx = Rows[r].DstOffset;
+      ForEachKeptRun(Cloud, Rows[r].Y, DecimationStep, [&](MIL_INT FirstX, MIL_INT EndX)
+         {
+         for(MIL_INT x = FirstX; x < EndX; x += DecimationStep, DstIdx++)
+            {
+            for(MIL_INT b = 0; b < 3; b++)
+               {
+               Gathered[b].push_back(Cloud.Range[b][RowOffset + x]);
+               if(HasColor)
+                  Merged.Color[b][DstIdx] = Cloud.Color[b][RowOffset + x];
+               }
+            }
+         });
+
+      const MIL_INT16* pSrc[3] = {Gathered[0].data(), Gathered[1].data(), Gathered[2].data()};
+      MIL_INT16* pDst[3];
+      for(MIL_INT b = 0; b < 3; b++)
+         pDst[b] = Merged.Range[b].data() + Rows[r].DstOffset;
+      TransformQuantizedPoints(pSrc, NbRowPoints[r], Affines[Rows[r].Cloud], pDst);
+      });
+
+   return Merged;
+   }
+
+//****************************************************************************
+// Dequantize and export a quantized point cloud.
+//****************************************************************************
+bool ExportQuantizedPointCloud(const SQuantizedPointCloud& Quantized, const MIL_STRING& FileName, EExportFormat Format,
+                               MIL_UINT64* pNbBytesWritten = nullptr)
+   {
+   std::array<std::vector<MIL_FLOAT>, 3> Range;
+   for(MIL_INT b = 0; b < 3; b++)
+      Range[b].resize(Quantized.NbPoints());
+
+   const MIL_INT NbChunks = (Quantized.NbPoints() + EXPORT_CHUNK_NB_POINTS - 1) / EXPORT_CHUNK_NB_POINTS;
+   ParallelForEachTask(NbChunks, GetNbWorkers(), [&](MIL_INT Chunk, MIL_INT)
+      {
+      MIL_INT End = std::min(Quantized.NbPoints(), (Chunk + 1) * EXPORT_CHUNK_NB_POINTS);
+      for(MIL_INT i = Chunk * EXPORT_CHUNK_NB_POINTS; i < End; i++)
+         {
+         bool IsValid = Quantized.Range[2][i] != QUANTIZED_INVALID;
+         for(MIL_INT b = 0; b < 3; b++)
+            {
+            const auto& Axis = Quantized.Axes[b];
+            Range[b][i] = IsValid ? static_cast<MIL_FLOAT>(Axis.Offset + Axis.Scale * Quantized.Range[b][i])
+                                  : std::numeric_limits<MIL_FLOAT>::quiet_NaN();
+            }
+         }
+      });
+
+   SPointCloudAccess Access;
+   Access.SizeX = Quantized.SizeX;
+   Access.SizeY = Quantized.SizeY;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Access.Range[b] = Range[b].data();
+      if(Quantized.HasColor())
+         Access.Color[b] = const_cast<MIL_UINT8*>(Quantized.Color[b].data());
+      }
+   Access.RangePitch = Quantized.SizeX;
+   Access.ColorPitch = Quantized.SizeX;
+   Access.IsValid = true;
+   return ExportPointCloud(Access, FileName, Format, GetNbWorkers(), pNbBytesWritten);
+   }
+
+//****************************************************************************
+// Allocate a container with a 16-bit range component that holds the
+// quantized points, with the scale and offset of each axis. A list of points
+// is laid out in rows padded with invalid points.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID AllocQuantizedContainer(MIL_ID MilSystem, const SQuantizedPointCloud& Quantized)
+   {
+   auto MilContainer = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   if(Quantized.NbPoints() == 0)
+      return MilContainer;
+
+   MIL_INT SizeX = Quantized.SizeX;
+   MIL_INT SizeY = Quantized.SizeY;
+   if(SizeY == 1 && SizeX > QUANTIZED_CONTAINER_SIZE_X)
+      {
+      SizeX = QUANTIZED_CONTAINER_SIZE_X;
+      SizeY = (Quantized.NbPoints() + SizeX - 1) / SizeX;
+      }
+   auto GetPadded = [&](const auto& Plane, MIL_INT PadValue)
+      {
+      auto Padded = Plane;
+      Padded.resize(SizeX * SizeY, static_cast<typename std::decay<decltype(Plane)>::type::value_type>(PadValue));
+      return Padded;
+      };
+
+   MIL_ID MilRange = MbufAllocComponent(MilContainer, 3, SizeX, SizeY, 16 + M_SIGNED, M_IMAGE + M_PROC + M_PLANAR,
+                                        M_COMPONENT_RANGE, M_NULL);
+   MbufControlContainer(MilContainer, M_COMPONENT_RANGE, M_3D_REPRESENTATION, M_CALIBRATED_XYZ);
+   MbufControl(MilRange, M_3D_INVALID_DATA_FLAG, M_TRUE);
+   MbufControl(MilRange, M_3D_INVALID_DATA_VALUE, QUANTIZED_INVALID);
+   const MIL_INT ScaleControls[3]  = {M_3D_SCALE_X, M_3D_SCALE_Y, M_3D_SCALE_Z};
+   const MIL_INT OffsetControls[3] = {M_3D_OFFSET_X, M_3D_OFFSET_Y, M_3D_OFFSET_Z};
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      MbufControl(MilRange, ScaleControls[b], Quantized.Axes[b].Scale);
+      MbufControl(MilRange, OffsetControls[b], Quantized.Axes[b].Offset);
+      MbufPutColor(MilRange, M_SINGLE_BAND, b, GetPadded(Quantized.Range[b], b == 2 ? QUANTIZED_INVALID : 0).data());
+      }
+
+   if(Quantized.HasColor())
+      {
+      MIL_ID MilReflectance = MbufAllocComponent(MilContainer, 3, SizeX, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PLANAR,
+                                                 M_COMPONENT_REFLECTANCE, M_NULL);
+      for(MIL_INT b = 0; b < 3; b++)
+         MbufPutColor(MilReflectance, M_SINGLE_BAND, b, GetPadded(Quantized.Color[b], 0).data());
+      }
+   return MilContainer;
+   }
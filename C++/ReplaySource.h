@@ -0,0 +1,492 @@
+﻿//***************************************************************************************/
+// 
+// File name: ReplaySource.h
+//
+// Synopsis: Implementation of a replay acquisition source that simulates multiple Altiz.
+//           Each virtual camera replays a scan as a stream of timestamped profiles at a
+//           configurable line rate, with jitter and dropped profiles. The profiles are
+//           assembled in frame buffers that are transformed and merged like live frames,
+//           which gives the maximum line rate that the merge can sustain.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+static const MIL_INT    REPLAY_NB_CAMERAS         = 3;
+static const MIL_DOUBLE REPLAY_LINE_RATE          = 1000.0;   // Profiles per second, per camera.
+static const MIL_DOUBLE REPLAY_JITTER             = 50.0e-6;  // Standard deviation of the profile times, in s.
+static const MIL_DOUBLE REPLAY_DROP_RATE          = 0.001;    // Probability that a profile is dropped.
+static const MIL_INT    REPLAY_NB_PARTS           = 6;        // Number of parts scanned in a run.
+static const MIL_INT    REPLAY_NB_FRAME_BUFFERS   = 2;        // Number of frame buffers of each camera.
+static const MIL_DOUBLE REPLAY_MAX_LINE_RATE      = 256000.0;
+static const MIL_INT    REPLAY_NB_BISECTION_STEPS = 4;
+
+// The cameras wake up at most once per period and emit all the profiles that are due.
+static const MIL_DOUBLE REPLAY_WAKE_UP_PERIOD     = 1.0e-3;   // in s
+
+// A run fails if the cameras emit their profiles slower than this ratio of the line rate.
+static const MIL_DOUBLE REPLAY_MIN_LINE_RATE_RATIO = 0.98;
+
+// Generated scans.
+static const MIL_INT    REPLAY_GENERATED_SIZE_X     = 2048;
+static const MIL_INT    REPLAY_GENERATED_SIZE_Y     = 1024;
+static const MIL_DOUBLE REPLAY_GENERATED_PIXEL_SIZE = 0.1;
+static const MIL_INT    REPLAY_GENERATED_KEY_SIZE   = 150;
+static const MIL_DOUBLE REPLAY_GENERATED_KEY_HEIGHT = 8.0;
+
+//****************************************************************************
+// Parameters of a replay run.
+//****************************************************************************
+struct SReplayParams
+   {
+   MIL_INT    NbCameras           = REPLAY_NB_CAMERAS;
+   MIL_DOUBLE LineRate            = REPLAY_LINE_RATE;
+   MIL_DOUBLE Jitter              = REPLAY_JITTER;
+   MIL_DOUBLE DropRate            = REPLAY_DROP_RATE;
+   MIL_INT    NbParts             = REPLAY_NB_PARTS;
+   MIL_INT    NbFrameBuffers      = REPLAY_NB_FRAME_BUFFERS;
+   MIL_INT    MergeDecimationStep = MERGE_DECIMATION_STEP;
+   };
+
+//****************************************************************************
+// Statistics of a replay run.
+//****************************************************************************
+struct SReplayStats
+   {
+   MIL_DOUBLE LineRate          = 0.0; // Requested, per camera.
+   MIL_DOUBLE AchievedLineRate  = 0.0; // Profiles emitted per second of wall time, per camera.
+   MIL_UINT64 NbProfiles        = 0; // Profiles emitted by the cameras.
+   MIL_UINT64 NbDroppedProfiles = 0; // Profiles dropped by the simulation.
+   MIL_UINT64 NbOverrunProfiles = 0; // Profiles lost because no frame buffer was free.
+   MIL_INT    NbMergedParts     = 0;
+   MIL_INT    NbLostFrames      = 0; // Frames released without being merged.
+   MIL_DOUBLE MeanMergeTime     = 0.0;
+   MIL_DOUBLE MaxLatency        = 0.0; // From the last profile of a part to the end of its merge.
+
+   bool IsLineRateAchieved() const { return AchievedLineRate >= REPLAY_MIN_LINE_RATE_RATIO * LineRate; }
+   bool IsSustainable() const { return NbOverrunProfiles == 0 && NbLostFrames == 0 && IsLineRateAchieved(); }
+   };
+
+//****************************************************************************
+// Frame buffer of a virtual camera.
+//****************************************************************************
+struct SReplayFrame
+   {
+   MIL_UNIQUE_BUF_ID       MilFrame;
+   SPointCloudAccess       Access;
+   std::vector<MIL_DOUBLE> Timestamps; // Time of each profile, NaN if missing.
+   MIL_INT                 PartIndex = -1;
+   bool                    IsFree = true;
+   };
+
+//****************************************************************************
+// Virtual camera replaying a scan.
+//****************************************************************************
+struct SVirtualCamera
+   {
+   SPointCloudAccess         Source;
+   SValidityIndex            SourceValidity;
+   MIL_ID                    MilMatrix = M_NULL;
+   std::vector<SReplayFrame> Frames;
+   std::deque<MIL_INT>       ReadyFrames;
+   bool                      IsDone = false;
+
+   MIL_UINT64 NbProfiles        = 0;
+   MIL_UINT64 NbDroppedProfiles = 0;
+   MIL_UINT64 NbOverrunProfiles = 0;
+   MIL_DOUBLE EndTime           = 0.0; // Time when the last profile was emitted.
+   };
+
+//****************************************************************************
+// Shared state of a replay run.
+//****************************************************************************
+struct SReplayContext
+   {
+   SReplayParams                         Params;
+   std::vector<SVirtualCamera>           Cameras;
+   std::chrono::steady_clock::time_point Start;
+   std::mutex                            Mutex;
+   std::condition_variable               FrameReady;
+
+   MIL_DOUBLE GetTime() const
+      {
+      return std::chrono::duration<MIL_DOUBLE>(std::chrono::steady_clock::now() - Start).count();
+      }
+   };
+
+//****************************************************************************
+// Allocate a frame buffer with the same components as the replayed scan.
+//****************************************************************************
+SReplayFrame AllocReplayFrame(MIL_ID MilSystem, MIL_ID MilSource)
+   {
+   SReplayFrame Frame;
+   Frame.MilFrame = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   MbufCopyComponent(MilSource, Frame.MilFrame, M_COMPONENT_RANGE, M_REPLACE, M_DEFAULT);
+   if(MbufInquireContainer(MilSource, M_COMPONENT_REFLECTANCE, M_COMPONENT_ID, M_NULL) != M_NULL)
+      MbufCopyComponent(MilSource, Frame.MilFrame, M_COMPONENT_REFLECTANCE, M_REPLACE, M_DEFAULT);
+
+   // The confidence marks the profiles that were received.
+   MIL_INT SizeX = MbufInquireContainer(MilSource, M_COMPONENT_RANGE, M_SIZE_X, M_NULL);
+   MIL_INT SizeY = MbufInquireContainer(MilSource, M_COMPONENT_RANGE, M_SIZE_Y, M_NULL);
+   MbufAllocComponent(Frame.MilFrame, 1, SizeX, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PROC, M_COMPONENT_CONFIDENCE, M_NULL);
+
+   Frame.Access = AccessPointCloud(Frame.MilFrame);
+   Frame.Timestamps.resize(SizeY);
+   return Frame;
+   }
+
+//****************************************************************************
+// Copy a profile of the replayed scan in a frame buffer. The confidence of the
+// frame buffer was cleared when it was acquired.
+//****************************************************************************
+void CopyProfile(const SPointCloudAccess& Source, SReplayFrame& Frame, MIL_INT Line)
+   {
+   auto& Access = Frame.Access;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      memcpy(Access.Range[b] + Line * Access.RangePitch, Source.Range[b] + Line * Source.RangePitch, Source.SizeX * sizeof(MIL_FLOAT));
+      if(Access.HasColor() && Source.HasColor())
+         memcpy(Access.Color[b] + Line * Access.ColorPitch, Source.Color[b] + Line * Source.ColorPitch, Source.SizeX);
+      }
+
+   MIL_UINT8* pConfidence = Access.Confidence + Line * Access.ConfidencePitch;
+   ForEachValidRun(Source, Line * Source.SizeX, (Line + 1) * Source.SizeX, [&](MIL_INT X, MIL_INT, MIL_INT Count)
+      {
+      memset(pConfidence + X, 255, Count);
+      });
+   }
+
+//****************************************************************************
+// Get a free frame buffer of a camera and clear it. Returns -1 if all the
+// frame buffers are still being processed.
+//****************************************************************************
+MIL_INT AcquireReplayFrame(SReplayContext& Context, SVirtualCamera& Camera)
+   {
+   MIL_INT FrameIndex = -1;
+   {
+   std::lock_guard<std::mutex> Lock(Context.Mutex);
+   for(MIL_INT f = 0; f < (MIL_INT)Camera.Frames.size() && FrameIndex < 0; f++)
+      {
+      if(Camera.Frames[f].IsFree)
+         {
+         Camera.Frames[f].IsFree = false;
+         FrameIndex = f;
+         }
+      }
+   }
+
+   if(FrameIndex >= 0)
+      {
+      auto& Frame = Camera.Frames[FrameIndex];
+      for(MIL_INT y = 0; y < Frame.Access.SizeY; y++)
+         memset(Frame.Access.Confidence + y * Frame.Access.ConfidencePitch, 0, Frame.Access.SizeX);
+      std::fill(Frame.Timestamps.begin(), Frame.Timestamps.end(), std::numeric_limits<MIL_DOUBLE>::quiet_NaN());
+      }
+   return FrameIndex;
+   }
+
+//****************************************************************************
+// Emit the profiles of a virtual camera at the line rate. A part is a replay
+// of the whole scan in one frame buffer. The camera sleeps until a profile is
+// due, then emits all the profiles due before its next wake-up, so that high
+// line rates don't need one wake-up per profile.
+//****************************************************************************
+void RunVirtualCamera(SReplayContext& Context, MIL_INT CameraIndex)
+   {
+   auto& Camera = Context.Cameras[CameraIndex];
+   const auto& Params = Context.Params;
+   std::mt19937 Generator(static_cast<unsigned int>(CameraIndex + 1));
+   std::normal_distribution<MIL_DOUBLE> Jitter(0.0, Params.Jitter);
+   std::bernoulli_distribution Drop(Params.DropRate);
+
+   const MIL_INT NbLines = Camera.Source.SizeY;
+   MIL_DOUBLE Now = Context.GetTime();
+   for(MIL_INT Part = 0; Part < Params.NbParts; Part++)
+      {
+      MIL_INT FrameIndex = AcquireReplayFrame(Context, Camera);
+      for(MIL_INT Line = 0; Line < NbLines; Line++)
+         {
+         // Wait for the time of the profile, or for the next wake-up if it is sooner.
+         MIL_DOUBLE Timestamp = (Part * NbLines + Line) / Params.LineRate + (Params.Jitter > 0.0 ? Jitter(Generator) : 0.0);
+         if(Timestamp > Now)
+            {
+            MIL_DOUBLE WakeUpTime = std::max(Timestamp, Now + REPLAY_WAKE_UP_PERIOD);
+            std::this_thread::sleep_until(Context.Start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<MIL_DOUBLE>(WakeUpTime)));
+            Now = Context.GetTime();
+            }
+
+         Camera.NbProfiles++;
+         if(Drop(Generator))
+            Camera.NbDroppedProfiles++;
+         else if(FrameIndex < 0)
+            Camera.NbOverrunProfiles++;
+         else
+            {
+            CopyProfile(Camera.Source, Camera.Frames[FrameIndex], Line);
+            Camera.Frames[FrameIndex].Timestamps[Line] = Timestamp;
+            }
+         }
+
+      if(FrameIndex >= 0)
+         {
+         std::lock_guard<std::mutex> Lock(Context.Mutex);
+         Camera.Frames[FrameIndex].PartIndex = Part;
+         Camera.ReadyFrames.push_back(FrameIndex);
+         Context.FrameReady.notify_one();
+         }
+      }
+
+   std::lock_guard<std::mutex> Lock(Context.Mutex);
+   Camera.EndTime = Context.GetTime();
+   Camera.IsDone = true;
+   Context.FrameReady.notify_one();
+   }
+
+//****************************************************************************
+// Wait until every camera has a frame of the same part. The frames of the
+// parts that some cameras lost are released. Returns false at the end of the
+// run. The context must be locked.
+//****************************************************************************
+bool WaitForReplayPart(SReplayContext& Context, std::unique_lock<std::mutex>& Lock, std::vector<MIL_INT>& FrameIndices,
+                       SReplayStats& Stats)
+   {
+   auto& Cameras = Context.Cameras;
+   while(true)
+      {
+      Context.FrameReady.wait(Lock, [&]()
+         {
+         for(const auto& Camera : Cameras)
+            {
+            if(Camera.ReadyFrames.empty() && !Camera.IsDone)
+               return false;
+            }
+         return true;
+         });
+
+      // Release the frames that can't be completed.
+      MIL_INT Part = -1;
+      bool IsComplete = true;
+      for(const auto& Camera : Cameras)
+         {
+         if(Camera.ReadyFrames.empty())
+            IsComplete = false;
+         else
+            Part = std::max(Part, Camera.Frames[Camera.ReadyFrames.front()].PartIndex);
+         }
+      for(auto& Camera : Cameras)
+         {
+         while(!Camera.ReadyFrames.empty() && (!IsComplete || Camera.Frames[Camera.ReadyFrames.front()].PartIndex < Part))
+            {
+            Camera.Frames[Camera.ReadyFrames.front()].IsFree = true;
+            Camera.ReadyFrames.pop_front();
+            Stats.NbLostFrames++;
+            }
+         }
+      if(!IsComplete)
+         return false;
+
+      bool IsAligned = true;
+      for(const auto& Camera : Cameras)
+         IsAligned = IsAligned && !Camera.ReadyFrames.empty();
+      if(IsAligned)
+         {
+         FrameIndices.clear();
+         for(auto& Camera : Cameras)
+            {
+            FrameIndices.push_back(Camera.ReadyFrames.front());
+            Camera.ReadyFrames.pop_front();
+            }
+         return true;
+         }
+      }
+   }
+
+//****************************************************************************
+// Replay the scans with virtual cameras and merge the parts as they are
+// completed. Camera c replays the scan and matrix c modulo their number.
+//****************************************************************************
+SReplayStats RunReplay(MIL_ID MilSystem, const std::vector<MIL_ID>& MilScans, const std::vector<MIL_ID>& MilMatrices,
+                       const SReplayParams& Params)
+   {
+   SReplayStats Stats;
+   Stats.LineRate = Params.LineRate;
+
+   SReplayContext Context;
+   Context.Params = Params;
+   Context.Cameras.resize(Params.NbCameras);
+   for(MIL_INT c = 0; c < Params.NbCameras; c++)
+      {
+      auto& Camera = Context.Cameras[c];
+      MIL_ID MilScan = MilScans[c % MilScans.size()];
+      Camera.Source = AccessPointCloud(MilScan);
+      if(!Camera.Source.IsValid)
+         return Stats;
+      Camera.SourceValidity = BuildValidityIndex(Camera.Source);
+      Camera.Source.pValidity = &Camera.SourceValidity;
+      Camera.MilMatrix = MilMatrices[c % MilMatrices.size()];
+      for(MIL_INT f = 0; f < Params.NbFrameBuffers; f++)
+         Camera.Frames.push_back(AllocReplayFrame(MilSystem, MilScan));
+      }
+
+   // Use decimation for subsampling, like the merge of the aligned point clouds.
+   MIL_UNIQUE_3DIM_ID MilSubsampleContext = M3dimAlloc(MilSystem, M_SUBSAMPLE_CONTEXT, M_DEFAULT, M_UNIQUE_ID);
+   M3dimControl(MilSubsampleContext, M_SUBSAMPLE_MODE, M_SUBSAMPLE_DECIMATE);
+   M3dimControl(MilSubsampleContext, M_ORGANIZATION_TYPE, M_ORGANIZED);
+   M3dimControl(MilSubsampleContext, M_STEP_SIZE_X, Params.MergeDecimationStep);
+   M3dimControl(MilSubsampleContext, M_STEP_SIZE_Y, Params.MergeDecimationStep);
+   auto MilMergedPointCloud = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+
+   // Start the virtual cameras.
+   Context.Start = std::chrono::steady_clock::now();
+   std::vector<std::thread> CameraThreads;
+   for(MIL_INT c = 0; c < Params.NbCameras; c++)
+      CameraThreads.emplace_back(RunVirtualCamera, std::ref(Context), c);
+
+   // Transform and merge the parts as the frames are completed.
+   MIL_DOUBLE TotalMergeTime = 0.0;
+   std::vector<MIL_INT> FrameIndices;
+   std::vector<MIL_ID> MilFrames(Params.NbCameras);
+   std::unique_lock<std::mutex> Lock(Context.Mutex);
+   while(WaitForReplayPart(Context, Lock, FrameIndices, Stats))
+      {
+      Lock.unlock();
+
+      MIL_DOUBLE LastProfileTime = 0.0;
+      MIL_DOUBLE MergeStartTime = Context.GetTime();
+      for(MIL_INT c = 0; c < Params.NbCameras; c++)
+         {
+         auto& Frame = Context.Cameras[c].Frames[FrameIndices[c]];
+         for(auto Timestamp : Frame.Timestamps)
+            {
+            if(!std::isnan(Timestamp))
+               LastProfileTime = std::max(LastProfileTime, Timestamp);
+            }
+         M3dimMatrixTransform(Frame.MilFrame, Frame.MilFrame, Context.Cameras[c].MilMatrix, M_DEFAULT);
+         MilFrames[c] = Frame.MilFrame;
+         }
+      M3dimMerge(MilFrames, MilMergedPointCloud, M_DEFAULT, MilSubsampleContext, M_DEFAULT);
+      MIL_DOUBLE MergeEndTime = Context.GetTime();
+
+      TotalMergeTime += MergeEndTime - MergeStartTime;
+      Stats.MaxLatency = std::max(Stats.MaxLatency, MergeEndTime - LastProfileTime);
+      Stats.NbMergedParts++;
+
+      Lock.lock();
+      for(MIL_INT c = 0; c < Params.NbCameras; c++)
+         Context.Cameras[c].Frames[FrameIndices[c]].IsFree = true;
+      }
+   Lock.unlock();
+
+   for(auto& CameraThread : CameraThreads)
+      CameraThread.join();
+
+   // The achieved line rate is measured on the slowest camera.
+   MIL_DOUBLE EndTime = 0.0;
+   for(const auto& Camera : Context.Cameras)
+      {
+      Stats.NbProfiles += Camera.NbProfiles;
+      Stats.NbDroppedProfiles += Camera.NbDroppedProfiles;
+      Stats.NbOverrunProfiles += Camera.NbOverrunProfiles;
+      EndTime = std::max(EndTime, Camera.EndTime);
+      }
+   if(EndTime > 0.0)
+      Stats.AchievedLineRate = Stats.NbProfiles / (Params.NbCameras * EndTime);
+   if(Stats.NbMergedParts > 0)
+      Stats.MeanMergeTime = TotalMergeTime / Stats.NbMergedParts;
+   return Stats;
+   }
+
+//****************************************************************************
+// Print the statistics of a replay run.
+//****************************************************************************
+void PrintReplayStats(const SReplayStats& Stats)
+   {
+   MosPrintf(MIL_TEXT("%10.0f | %10.0f | %8llu | %7llu | %7llu | %6d | %9.1f | %11.1f | %s\n"),
+             Stats.LineRate, Stats.AchievedLineRate, (unsigned long long)Stats.NbProfiles, (unsigned long long)Stats.NbDroppedProfiles,
+             (unsigned long long)Stats.NbOverrunProfiles, (int)Stats.NbMergedParts, Stats.MeanMergeTime * 1000.0,
+             Stats.MaxLatency * 1000.0, Stats.IsSustainable() ? MIL_TEXT("yes") : MIL_TEXT("no"));
+   }
+
+//****************************************************************************
+// Find the maximum line rate that the merge sustains. The line rate is doubled
+// until the merge can't keep up, then refined by bisection. A run where the
+// virtual cameras fall short of the line rate counts as failed.
+//****************************************************************************
+MIL_DOUBLE FindMaxSustainableLineRate(MIL_ID MilSystem, const std::vector<MIL_ID>& MilScans, const std::vector<MIL_ID>& MilMatrices,
+                                      const SReplayParams& Params)
+   {
+   MosPrintf(MIL_TEXT("Replaying the scans with %d virtual cameras, %d parts per run.\n\n"), (int)Params.NbCameras, (int)Params.NbParts);
+   MosPrintf(MIL_TEXT(" Line rate |   Achieved | Profiles | Dropped | Overrun |  Parts | Merge(ms) | Latency(ms) | Sustained\n"));
+   MosPrintf(MIL_TEXT("-----------+------------+----------+---------+---------+--------+-----------+-------------+----------\n"));
+
+   auto RunParams = Params;
+   MIL_DOUBLE SustainedRate = 0.0;
+   MIL_DOUBLE FailedRate = 0.0;
+   for(RunParams.LineRate = Params.LineRate; RunParams.LineRate <= REPLAY_MAX_LINE_RATE && FailedRate == 0.0; RunParams.LineRate *= 2.0)
+      {
+      auto Stats = RunReplay(MilSystem, MilScans, MilMatrices, RunParams);
+      PrintReplayStats(Stats);
+      if(Stats.IsSustainable())
+         SustainedRate = RunParams.LineRate;
+      else
+         FailedRate = RunParams.LineRate;
+      }
+
+   for(MIL_INT Step = 0; Step < REPLAY_NB_BISECTION_STEPS && FailedRate > 0.0; Step++)
+      {
+      RunParams.LineRate = 0.5 * (SustainedRate + FailedRate);
+      auto Stats = RunReplay(MilSystem, MilScans, MilMatrices, RunParams);
+      PrintReplayStats(Stats);
+      if(Stats.IsSustainable())
+         SustainedRate = RunParams.LineRate;
+      else
+         FailedRate = RunParams.LineRate;
+      }
+
+   if(FailedRate > 0.0)
+      MosPrintf(MIL_TEXT("\nThe merge sustains %.0f profiles/s per camera and breaks at %.0f profiles/s.\n\n"), SustainedRate, FailedRate);
+   else
+      MosPrintf(MIL_TEXT("\nThe merge sustains at least %.0f profiles/s per camera.\n\n"), SustainedRate);
+   return SustainedRate;
+   }
+
+//****************************************************************************
+// Generate a keyboard-like scan: raised keys on a flat plate, with missing
+// points on the key borders.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID GenerateReplayScan(MIL_ID MilSystem, MIL_INT SizeX, MIL_INT SizeY)
+   {
+   auto MilScan = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   MbufAllocComponent(MilScan, 3, SizeX, SizeY, 32 + M_FLOAT, M_IMAGE + M_PROC + M_PLANAR, M_COMPONENT_RANGE, M_NULL);
+   MbufAllocComponent(MilScan, 1, SizeX, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PROC, M_COMPONENT_CONFIDENCE, M_NULL);
+   MbufControlContainer(MilScan, M_COMPONENT_RANGE, M_3D_REPRESENTATION, M_CALIBRATED_XYZ);
+
+   auto Access = AccessPointCloud(MilScan);
+   if(!Access.IsValid)
+      return MilScan;
+
+   for(MIL_INT y = 0; y < SizeY; y++)
+      {
+      for(MIL_INT x = 0; x < SizeX; x++)
+         {
+         MIL_INT KeyX = x % REPLAY_GENERATED_KEY_SIZE;
+         MIL_INT KeyY = y % REPLAY_GENERATED_KEY_SIZE;
+         bool IsKey = KeyX > REPLAY_GENERATED_KEY_SIZE / 10 && KeyY > REPLAY_GENERATED_KEY_SIZE / 10;
+         bool IsBorder = KeyX == REPLAY_GENERATED_KEY_SIZE / 10 || KeyY == REPLAY_GENERATED_KEY_SIZE / 10;
+
+         Access.Range[0][y * Access.RangePitch + x] = static_cast<MIL_FLOAT>(x * REPLAY_GENERATED_PIXEL_SIZE);
+         Access.Range[1][y * Access.RangePitch + x] = static_cast<MIL_FLOAT>(y * REPLAY_GENERATED_PIXEL_SIZE);
+         Access.Range[2][y * Access.RangePitch + x] = static_cast<MIL_FLOAT>(IsKey ? REPLAY_GENERATED_KEY_HEIGHT : 0.0);
+         Access.Confidence[y * Access.ConfidencePitch + x] = IsBorder ? 0 : 255;
+         }
+      }
+   return MilScan;
+   }
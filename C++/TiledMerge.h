@@ -0,0 +1,348 @@
+﻿//***************************************************************************************/
+// 
+// File name: TiledMerge.h
+//
+// Synopsis: Implementation of the out-of-core merge of the aligned point clouds. The
+//           aligned space is split in fixed-size tiles along the scan (Y) axis. Each
+//           point cloud is transformed directly into the tiles, which spill to disk
+//           under a memory cap and are written as independent tiled files.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+#include <map>
+#include <memory>
+#include <mutex>
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+// The memory cap only covers the points held by the merger, not the point cloud being added.
+static const MIL_DOUBLE TILED_MERGE_TILE_SIZE_Y   = 50.0;
+static const MIL_UINT64 TILED_MERGE_MEMORY_CAP    = 256 * 1024 * 1024;
+static const MIL_INT    TILED_MERGE_BAND_NB_ROWS  = 64;
+
+//****************************************************************************
+// Information on a merged tile file.
+//****************************************************************************
+struct SMergedTileInfo
+   {
+   MIL_INT    Index;
+   MIL_DOUBLE MinY;
+   MIL_DOUBLE MaxY;
+   MIL_UINT64 NbPoints;
+   MIL_STRING FileName;
+   };
+
+//****************************************************************************
+// Out-of-core merge of point clouds in tiles along Y. The point clouds are
+// added one at a time; the caller only needs to keep the one being added.
+//****************************************************************************
+class CTiledMerger
+   {
+   public:
+      CTiledMerger(const MIL_STRING& FilePrefix, MIL_DOUBLE TileSizeY, MIL_INT DecimationStep, MIL_UINT64 MemoryCap)
+         : m_FilePrefix(FilePrefix), m_TileSizeY(TileSizeY), m_DecimationStep(std::max<MIL_INT>(1, DecimationStep)),
+           m_MemoryCap(MemoryCap), m_NbWorkers(GetNbWorkers())
+         {}
+
+      // Returns false if the point cloud cannot be accessed or a tile cannot be spilled.
+      bool AddPointCloud(MIL_ID MilPointCloud, MIL_ID MilMatrix, const SValidityIndex* pValidity = nullptr);
+      std::vector<SMergedTileInfo> Finalize(EExportFormat Format);
+
+   private:
+      // Points of a tile, in planes.
+      struct SPointPlanes
+         {
+         std::array<std::vector<MIL_FLOAT>, 3> Range;
+         std::array<std::vector<MIL_UINT8>, 3> Color;
+         size_t Size() const { return Range[0].size(); }
+         };
+
+      struct STile
+         {
+         std::mutex   Mutex;
+         SPointPlanes Points;
+         MIL_UINT64   NbSpilledPoints = 0;
+         };
+
+      STile&     GetTile(MIL_INT TileIndex);
+      void       AppendToTile(MIL_INT TileIndex, SPointPlanes& Points);
+      void       SpillTiles();
+      bool       SpillTile(MIL_INT TileIndex, STile& Tile);
+      bool       ReloadTile(MIL_INT TileIndex, STile& Tile, SPointPlanes& Points);
+      MIL_STRING GetSpillFileName(MIL_INT TileIndex) const;
+      MIL_UINT64 GetPointSize() const { return 3 * sizeof(MIL_FLOAT) + (m_HasColor ? 3 : 0); }
+
+      MIL_STRING m_FilePrefix;
+      MIL_DOUBLE m_TileSizeY;
+      MIL_INT    m_DecimationStep;
+      MIL_UINT64 m_MemoryCap;
+      MIL_INT    m_NbWorkers;
+      bool       m_HasColor = false;
+      MIL_INT    m_NbPointClouds = 0;
+
+      std::mutex                                m_TilesMutex;
+      std::map<MIL_INT, std::unique_ptr<STile>> m_Tiles;
+      std::atomic<MIL_UINT64>                   m_NbBytesInMemory{0};
+      std::atomic<bool>                         m_HasSpillFailed{false};
+   };
+
+//****************************************************************************
+// Transform a point cloud and add its points to the tiles. The rows of the
+// point cloud are processed in bands by the workers; the points of a band are
+// binned per tile locally before being appended to the shared tiles. Only the
+// runs of valid points are visited if the validity index is given.
+//****************************************************************************
+bool CTiledMerger::AddPointCloud(MIL_ID MilPointCloud, MIL_ID MilMatrix, const SValidityIndex* pValidity)
+   {
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return false;
+   SetValidityIndex(Access, pValidity);
+   if(m_NbPointClouds++ == 0)
+      m_HasColor = Access.HasColor();
+
+   MIL_DOUBLE Matrix[16];
+   M3dgeoMatrixGet(MilMatrix, M_DEFAULT, Matrix);
+
+   const MIL_INT NbBands = (Access.SizeY + TILED_MERGE_BAND_NB_ROWS - 1) / TILED_MERGE_BAND_NB_ROWS;
+   ParallelForEachTask(NbBands, m_NbWorkers, [&](MIL_INT Band, MIL_INT)
+      {
+      std::map<MIL_INT, SPointPlanes> Bins;
+      MIL_INT EndY = std::min(Access.SizeY, (Band + 1) * TILED_MERGE_BAND_NB_ROWS);
+      for(MIL_INT Y = Band * TILED_MERGE_BAND_NB_ROWS; Y < EndY; Y++)
+         {
+         // Keep the same points as the decimation of the in-memory merge.
+         if(Y % m_DecimationStep != 0)
+            continue;
+
+         ForEachValidRun(Access, Y * Access.SizeX, (Y + 1) * Access.SizeX, [&](MIL_INT RunX, MIL_INT RunY, MIL_INT Count)
+            {
+            MIL_INT FirstX = ((RunX + m_DecimationStep - 1) / m_DecimationStep) * m_DecimationStep;
+            for(MIL_INT X = FirstX; X < RunX + Count; X += m_DecimationStep)
+               {
+               MIL_INT RangeIdx = RunY * Access.RangePitch + X;
+               MIL_DOUBLE P[3] = {Access.Range[0][RangeIdx], Access.Range[1][RangeIdx], Access.Range[2][RangeIdx]};
+               MIL_FLOAT T[3];
+               for(MIL_INT r = 0; r < 3; r++)
+                  T[r] = static_cast<MIL_FLOAT>(Matrix[4 * r] * P[0] + Matrix[4 * r + 1] * P[1] + Matrix[4 * r + 2] * P[2] + Matrix[4 * r + 3]);
+
+               auto& Bin = Bins[static_cast<MIL_INT>(floor(T[1] / m_TileSizeY))];
+               for(MIL_INT b = 0; b < 3; b++)
+                  Bin.Range[b].push_back(T[b]);
+               if(m_HasColor)
+                  {
+                  MIL_INT ColorIdx = RunY * Access.ColorPitch + X;
+                  for(MIL_INT b = 0; b < 3; b++)
+                     Bin.Color[b].push_back(Access.HasColor() ? Access.Color[b][ColorIdx] : 255);
+                  }
+               }
+            });
+         }
+
+      for(auto& Bin : Bins)
+         AppendToTile(Bin.first, Bin.second);
+      });
+
+   return !m_HasSpillFailed;
+   }
+
+//****************************************************************************
+// Get a tile, allocating it if required.
+//****************************************************************************
+CTiledMerger::STile& CTiledMerger::GetTile(MIL_INT TileIndex)
+   {
+   std::lock_guard<std::mutex> Lock(m_TilesMutex);
+   auto& Tile = m_Tiles[TileIndex];
+   if(!Tile)
+      Tile.reset(new STile);
+   return *Tile;
+   }
+
+//****************************************************************************
+// Append points to a tile and spill the tiles if the memory cap is exceeded.
+// The memory in use is counted under the lock of the tile, like in
+// SpillTile(), so the points are never subtracted before they are added.
+//****************************************************************************
+void CTiledMerger::AppendToTile(MIL_INT TileIndex, SPointPlanes& Points)
+   {
+   auto& Tile = GetTile(TileIndex);
+   MIL_UINT64 NbBytesInMemory;
+   {
+   std::lock_guard<std::mutex> Lock(Tile.Mutex);
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Tile.Points.Range[b].insert(Tile.Points.Range[b].end(), Points.Range[b].begin(), Points.Range[b].end());
+      Tile.Points.Color[b].insert(Tile.Points.Color[b].end(), Points.Color[b].begin(), Points.Color[b].end());
+      }
+   NbBytesInMemory = (m_NbBytesInMemory += Points.Size() * GetPointSize());
+   }
+
+   if(NbBytesInMemory > m_MemoryCap)
+      SpillTiles();
+   }
+
+//****************************************************************************
+// Spill tiles to disk until half of the memory cap is used. Each tile is
+// visited at most once. Once a spill has failed, the points are kept in memory.
+//****************************************************************************
+void CTiledMerger::SpillTiles()
+   {
+   if(m_HasSpillFailed)
+      return;
+
+   std::vector<std::pair<MIL_INT, STile*>> Tiles;
+   {
+   std::lock_guard<std::mutex> Lock(m_TilesMutex);
+   for(auto& Tile : m_Tiles)
+      Tiles.emplace_back(Tile.first, Tile.second.get());
+   }
+
+   for(auto& Tile : Tiles)
+      {
+      if(m_NbBytesInMemory <= m_MemoryCap / 2 || m_HasSpillFailed)
+         break;
+      std::lock_guard<std::mutex> Lock(Tile.second->Mutex);
+      if(!SpillTile(Tile.first, *Tile.second))
+         m_HasSpillFailed = true;
+      }
+   }
+
+//****************************************************************************
+// Append the in-memory points of a tile to its spill file. The first spill of
+// the tile truncates the file, so a file left by an aborted run is not
+// reloaded. The tile must be locked. If the points cannot be written, they
+// are kept in memory and false is returned.
+//****************************************************************************
+bool CTiledMerger::SpillTile(MIL_INT TileIndex, STile& Tile)
+   {
+   MIL_UINT64 NbPoints = Tile.Points.Size();
+   if(NbPoints == 0)
+      return true;
+
+   std::ofstream File(GetSpillFileName(TileIndex), std::ios::binary | (Tile.NbSpilledPoints == 0 ? std::ios::trunc : std::ios::app));
+   File.write(reinterpret_cast<const char*>(&NbPoints), sizeof(NbPoints));
+   for(MIL_INT b = 0; b < 3; b++)
+      File.write(reinterpret_cast<const char*>(Tile.Points.Range[b].data()), NbPoints * sizeof(MIL_FLOAT));
+   for(MIL_INT b = 0; b < (m_HasColor ? 3 : 0); b++)
+      File.write(reinterpret_cast<const char*>(Tile.Points.Color[b].data()), NbPoints);
+   File.close();
+   if(File.fail())
+      {
+      MosPrintf(MIL_TEXT("An error occurred while writing the file %s.\n\n"), GetSpillFileName(TileIndex).c_str());
+      return false;
+      }
+
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      std::vector<MIL_FLOAT>().swap(Tile.Points.Range[b]);
+      std::vector<MIL_UINT8>().swap(Tile.Points.Color[b]);
+      }
+   Tile.NbSpilledPoints += NbPoints;
+   m_NbBytesInMemory -= NbPoints * GetPointSize();
+   return true;
+   }
+
+//****************************************************************************
+// Gather the spilled and in-memory points of a tile. The spill file is
+// rejected if its blocks do not add up to the spilled points.
+//****************************************************************************
+bool CTiledMerger::ReloadTile(MIL_INT TileIndex, STile& Tile, SPointPlanes& Points)
+   {
+   const MIL_INT NbColorBands = m_HasColor ? 3 : 0;
+   const size_t NbPoints = static_cast<size_t>(Tile.NbSpilledPoints) + Tile.Points.Size();
+   for(MIL_INT b = 0; b < 3; b++)
+      Points.Range[b].resize(NbPoints);
+   for(MIL_INT b = 0; b < NbColorBands; b++)
+      Points.Color[b].resize(NbPoints);
+
+   size_t Pos = 0;
+   if(Tile.NbSpilledPoints > 0)
+      {
+      std::ifstream File(GetSpillFileName(TileIndex), std::ios::binary);
+      MIL_UINT64 NbBlockPoints;
+      while(Pos < Tile.NbSpilledPoints && File.read(reinterpret_cast<char*>(&NbBlockPoints), sizeof(NbBlockPoints)))
+         {
+         if(NbBlockPoints == 0 || Pos + NbBlockPoints > Tile.NbSpilledPoints)
+            return false;
+         for(MIL_INT b = 0; b < 3; b++)
+            File.read(reinterpret_cast<char*>(Points.Range[b].data() + Pos), NbBlockPoints * sizeof(MIL_FLOAT));
+         for(MIL_INT b = 0; b < NbColorBands; b++)
+            File.read(reinterpret_cast<char*>(Points.Color[b].data() + Pos), NbBlockPoints);
+         if(!File.good())
+            return false;
+         Pos += static_cast<size_t>(NbBlockPoints);
+         }
+      if(Pos != Tile.NbSpilledPoints)
+         return false;
+      MappFileOperation(M_DEFAULT, GetSpillFileName(TileIndex), M_NULL, M_NULL, M_FILE_DELETE, M_DEFAULT, M_NULL);
+      }
+
+   for(MIL_INT b = 0; b < 3; b++)
+      std::copy(Tile.Points.Range[b].begin(), Tile.Points.Range[b].end(), Points.Range[b].begin() + Pos);
+   for(MIL_INT b = 0; b < NbColorBands; b++)
+      std::copy(Tile.Points.Color[b].begin(), Tile.Points.Color[b].end(), Points.Color[b].begin() + Pos);
+   return true;
+   }
+
+//****************************************************************************
+// Write each tile in its own file. The tiles are written in parallel and only
+// the tiles being written are fully loaded in memory.
+//****************************************************************************
+std::vector<SMergedTileInfo> CTiledMerger::Finalize(EExportFormat Format)
+   {
+   std::vector<std::pair<MIL_INT, STile*>> Tiles;
+   for(auto& Tile : m_Tiles)
+      Tiles.emplace_back(Tile.first, Tile.second.get());
+
+   std::vector<SMergedTileInfo> TileInfos(Tiles.size());
+   std::atomic<bool> Success(true);
+   ParallelForEachTask(static_cast<MIL_INT>(Tiles.size()), m_NbWorkers, [&](MIL_INT t, MIL_INT)
+      {
+      MIL_INT TileIndex = Tiles[t].first;
+      SPointPlanes Points;
+      if(!ReloadTile(TileIndex, *Tiles[t].second, Points))
+         {
+         Success = false;
+         return;
+         }
+
+      // Export the tile through a direct access to its planes.
+      SPointCloudAccess Access;
+      Access.SizeX = static_cast<MIL_INT>(Points.Size());
+      Access.SizeY = 1;
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         Access.Range[b] = Points.Range[b].data();
+         if(m_HasColor)
+            Access.Color[b] = Points.Color[b].data();
+         }
+      Access.RangePitch = Access.SizeX;
+      Access.ColorPitch = Access.SizeX;
+      Access.IsValid = true;
+
+      auto& TileInfo = TileInfos[t];
+      TileInfo.Index = TileIndex;
+      TileInfo.MinY = TileIndex * m_TileSizeY;
+      TileInfo.MaxY = (TileIndex + 1) * m_TileSizeY;
+      TileInfo.NbPoints = Points.Size();
+      TileInfo.FileName = m_FilePrefix + MIL_TEXT("Tile") + M_TO_STRING(TileIndex) + GetExportFileExtension(Format);
+      if(!ExportPointCloud(Access, TileInfo.FileName, Format, 1))
+         Success = false;
+      });
+
+   m_Tiles.clear();
+   m_NbBytesInMemory = 0;
+   if(!Success)
+      MosPrintf(MIL_TEXT("An error occurred while writing the merged tiles.\n\n"));
+   return TileInfos;
+   }
+
+//****************************************************************************
+// Get the name of the spill file of a tile.
+//****************************************************************************
+MIL_STRING CTiledMerger::GetSpillFileName(MIL_INT TileIndex) const
+   {
+   return m_FilePrefix + MIL_TEXT("Tile") + M_TO_STRING(TileIndex) + MIL_TEXT(".spill");
+   }
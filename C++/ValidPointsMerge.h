@@ -0,0 +1,185 @@
+﻿//***************************************************************************************/
+// 
+// File name: ValidPointsMerge.h
+//
+// Synopsis: Implementation of the transformation and the merge of the point clouds that
+//           only visit the runs of valid points given by their validity index. The
+//           transformation keeps the organization of the point clouds, so they can still
+//           be projected in depth maps; the merge compacts the kept points in a list.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+
+//*****************************************************************************
+// Constants.
+//*****************************************************************************
+static const MIL_INT VALID_POINTS_BAND_NB_ROWS      = 64;   // Rows of the point cloud per transformed band.
+static const MIL_INT VALID_POINTS_CONTAINER_SIZE_X  = 4096; // Row size of the containers of merged points.
+
+//****************************************************************************
+// Transform the valid points of a point cloud in place. The invalid points are
+// not visited and the organization of the point cloud is kept. The normals, if
+// any, are rotated with the points.
+//****************************************************************************
+bool TransformValidPoints(MIL_ID MilPointCloud, MIL_ID MilMatrix, const SValidityIndex* pValidity = nullptr)
+   {
+   auto Access = AccessPointCloud(MilPointCloud);
+   if(!Access.IsValid)
+      return false;
+   SetValidityIndex(Access, pValidity);
+
+   MIL_DOUBLE Matrix[16];
+   M3dgeoMatrixGet(MilMatrix, M_DEFAULT, Matrix);
+
+   std::array<MIL_UNIQUE_BUF_ID, 3> MilNormalsBands;
+   std::array<MIL_FLOAT*, 3> Normals = {};
+   MIL_INT NormalsPitch = 0;
+   MIL_ID MilNormals = MbufInquireContainer(MilPointCloud, M_COMPONENT_NORMALS_MIL, M_COMPONENT_ID, M_NULL);
+   if(MilNormals && MbufInquire(MilNormals, M_SIZE_BAND, M_NULL) == 3 && MbufInquire(MilNormals, M_TYPE, M_NULL) == 32 + M_FLOAT)
+      {
+      for(MIL_INT b = 0; b < 3; b++)
+         {
+         MilNormalsBands[b] = MbufChildColor(MilNormals, b, M_UNIQUE_ID);
+         Normals[b] = GetHostAddress<MIL_FLOAT>(MilNormalsBands[b]);
+         }
+      NormalsPitch = MbufInquire(MilNormalsBands[0], M_PITCH, M_NULL);
+      }
+
+   const MIL_INT NbBands = (Access.SizeY + VALID_POINTS_BAND_NB_ROWS - 1) / VALID_POINTS_BAND_NB_ROWS;
+   ParallelForEachTask(NbBands, GetNbWorkers(), [&](MIL_INT Band, MIL_INT)
+      {
+      MIL_INT Begin = Band * VALID_POINTS_BAND_NB_ROWS * Access.SizeX;
+      MIL_INT End = std::min(Access.SizeY, (Band + 1) * VALID_POINTS_BAND_NB_ROWS) * Access.SizeX;
+      ForEachValidRun(Access, Begin, End, [&](MIL_INT RunX, MIL_INT RunY, MIL_INT Count)
+         {
+         for(MIL_INT X = RunX; X < RunX + Count; X++)
+            {
+            MIL_INT RangeIdx = RunY * Access.RangePitch + X;
+            MIL_DOUBLE P[3] = {Access.Range[0][RangeIdx], Access.Range[1][RangeIdx], Access.Range[2][RangeIdx]};
+            for(MIL_INT r = 0; r < 3; r++)
+               Access.Range[r][RangeIdx] = static_cast<MIL_FLOAT>(Matrix[4 * r] * P[0] + Matrix[4 * r + 1] * P[1] + Matrix[4 * r + 2] * P[2] + Matrix[4 * r + 3]);
+
+            if(Normals[0])
+               {
+               MIL_INT NormalIdx = RunY * NormalsPitch + X;
+               MIL_DOUBLE N[3] = {Normals[0][NormalIdx], Normals[1][NormalIdx], Normals[2][NormalIdx]};
+               for(MIL_INT r = 0; r < 3; r++)
+                  Normals[r][NormalIdx] = static_cast<MIL_FLOAT>(Matrix[4 * r] * N[0] + Matrix[4 * r + 1] * N[1] + Matrix[4 * r + 2] * N[2]);
+               }
+            }
+         });
+      });
+
+   return true;
+   }
+
+//****************************************************************************
+// Merge the valid points of point clouds, with the same decimation as the
+// merge of the containers. The kept points are compacted in a list laid out
+// in rows padded with invalid points; only the runs of valid points of the
+// point clouds are visited.
+//****************************************************************************
+MIL_UNIQUE_BUF_ID MergeValidPoints(MIL_ID MilSystem, const std::vector<MIL_ID>& MilPointClouds,
+                                   const std::vector<const SValidityIndex*>& ValidityIndices, MIL_INT DecimationStep)
+   {
+   auto MilMergedPointCloud = MbufAllocContainer(MilSystem, M_PROC + M_DISP, M_DEFAULT, M_UNIQUE_ID);
+   DecimationStep = std::max<MIL_INT>(1, DecimationStep);
+
+   std::vector<SPointCloudAccess> Accesses;
+   bool HasColor = !MilPointClouds.empty();
+   for(size_t c = 0; c < MilPointClouds.size(); c++)
+      {
+      Accesses.push_back(AccessPointCloud(MilPointClouds[c]));
+      if(!Accesses.back().IsValid)
+         return MilMergedPointCloud;
+      SetValidityIndex(Accesses.back(), c < ValidityIndices.size() ? ValidityIndices[c] : nullptr);
+      HasColor = HasColor && Accesses.back().HasColor();
+      }
+
+   // Count the kept points of each row to place the rows in the merged point cloud.
+   struct SRow
+      {
+      MIL_INT Cloud;
+      MIL_INT Y;
+      MIL_INT DstOffset;
+      };
+   std::vector<SRow> Rows;
+   for(MIL_INT c = 0; c < (MIL_INT)Accesses.size(); c++)
+      {
+      for(MIL_INT y = 0; y < Accesses[c].SizeY; y += DecimationStep)
+         Rows.push_back({c, y, 0});
+      }
+   auto ForEachKeptRun = [&](const SPointCloudAccess& Access, MIL_INT Y, auto Func)
+      {
+      ForEachValidRun(Access, Y * Access.SizeX, (Y + 1) * Access.SizeX, [&](MIL_INT X, MIL_INT, MIL_INT Count)
+         {
+         MIL_INT FirstX = ((X + DecimationStep - 1) / DecimationStep) * DecimationStep;
+         if(FirstX < X + Count)
+            Func(FirstX, X + Count);
+         });
+      };
+   std::vector<MIL_INT> NbRowPoints(Rows.size(), 0);
+   ParallelForEachTask((MIL_INT)Rows.size(), GetNbWorkers(), [&](MIL_INT r, MIL_INT)
+      {
+      ForEachKeptRun(Accesses[Rows[r].Cloud], Rows[r].Y, [&](MIL_INT FirstX, MIL_INT EndX)
+         {
+         NbRowPoints[r] += (EndX - FirstX + DecimationStep - 1) / DecimationStep;
+         });
+      });
+   MIL_INT NbPoints = 0;
+   for(size_t r = 0; r < Rows.size(); r++)
+      {
+      Rows[r].DstOffset = NbPoints;
+      NbPoints += NbRowPoints[r];
+      }
+   if(NbPoints == 0)
+      return MilMergedPointCloud;
+
+   // Gather the kept points of each row in the merged planes, padded with invalid points.
+   const MIL_INT SizeX = std::min(NbPoints, VALID_POINTS_CONTAINER_SIZE_X);
+   const MIL_INT SizeY = (NbPoints + SizeX - 1) / SizeX;
+   std::array<std::vector<MIL_FLOAT>, 3> Range;
+   std::array<std::vector<MIL_UINT8>, 3> Color;
+   for(MIL_INT b = 0; b < 3; b++)
+      {
+      Range[b].resize(SizeX * SizeY, b == 2 ? std::numeric_limits<MIL_FLOAT>::quiet_NaN() : 0.0f);
+      if(HasColor)
+         Color[b].resize(SizeX * SizeY, 0);
+      }
+
+   ParallelForEachTask((MIL_INT)Rows.size(), GetNbWorkers(), [&](MIL_INT r, MIL_INT)
+      {
+      const auto& Access = Accesses[Rows[r].Cloud];
+      const MIL_INT Y = Rows[r].Y;
+      MIL_INT DstIdx = Rows[r].DstOffset;
+      ForEachKeptRun(Access, Y, [&](MIL_INT FirstX, MIL_INT EndX)
+         {
+         for(MIL_INT X = FirstX; X < EndX; X += DecimationStep, DstIdx++)
+            {
+            for(MIL_INT b = 0; b < 3; b++)
+               {
+               Range[b][DstIdx] = Access.Range[b][Y * Access.RangePitch + X];
+               if(HasColor)
+                  Color[b][DstIdx] = Access.Color[b][Y * Access.ColorPitch + X];
+               }
+            }
+         });
+      });
+
+   MIL_ID MilRange = MbufAllocComponent(MilMergedPointCloud, 3, SizeX, SizeY, 32 + M_FLOAT, M_IMAGE + M_PROC + M_PLANAR,
+                                        M_COMPONENT_RANGE, M_NULL);
+   MbufControlContainer(MilMergedPointCloud, M_COMPONENT_RANGE, M_3D_REPRESENTATION, M_CALIBRATED_XYZ);
+   for(MIL_INT b = 0; b < 3; b++)
+      MbufPutColor(MilRange, M_SINGLE_BAND, b, Range[b].data());
+
+   if(HasColor)
+      {
+      MIL_ID MilReflectance = MbufAllocComponent(MilMergedPointCloud, 3, SizeX, SizeY, 8 + M_UNSIGNED, M_IMAGE + M_PLANAR,
+                                                 M_COMPONENT_REFLECTANCE, M_NULL);
+      for(MIL_INT b = 0; b < 3; b++)
+         MbufPutColor(MilReflectance, M_SINGLE_BAND, b, Color[b].data());
+      }
+
+   return MilMergedPointCloud;
+   }
@@ -0,0 +1,98 @@
+﻿//***************************************************************************************/
+// 
+// File name: ValidityIndex.h
+//
+// Synopsis: Implementation of the run-length index of the valid points of an organized
+//           point cloud. The index is built once per scan by the stages that visit its
+//           points, so that they only visit the runs of valid points instead of every
+//           pixel.
+// 
+// Copyright © Matrox Electronic Systems Ltd., 1992-YYYY.
+// All Rights Reserved
+//*************************************************************************************/
+
+//****************************************************************************
+// Run of consecutive valid points in a row.
+//****************************************************************************
+struct SValidRun
+   {
+   MIL_INT32 X;
+   MIL_INT32 Count;
+   };
+
+//****************************************************************************
+// Run-length index of the valid points of an organized point cloud. The runs
+// of row y are Runs[RowFirstRun[y]] to Runs[RowFirstRun[y + 1] - 1].
+//****************************************************************************
+struct SValidityIndex
+   {
+   MIL_INT                SizeX = 0;
+   MIL_INT                SizeY = 0;
+   MIL_INT                NbValidPoints = 0;
+   std::vector<SValidRun> Runs;
+   std::vector<MIL_INT>   RowFirstRun;
+
+   bool IsEmpty() const { return RowFirstRun.empty(); }
+
+   // Call the function on every run, clipped to the [Begin, End) range of
+   // point indices, in row-major order.
+   template <class RunFunc>
+   void ForEachRun(MIL_INT Begin, MIL_INT End, RunFunc Func) const
+      {
+      if(Begin >= End)
+         return;
+      MIL_INT LastY = (End - 1) / SizeX;
+      for(MIL_INT Y = Begin / SizeX; Y <= LastY; Y++)
+         {
+         MIL_INT RowBegin = std::max<MIL_INT>(0, Begin - Y * SizeX);
+         MIL_INT RowEnd = std::min<MIL_INT>(SizeX, End - Y * SizeX);
+         for(MIL_INT r = RowFirstRun[Y]; r < RowFirstRun[Y + 1]; r++)
+            {
+            MIL_INT RunBegin = std::max<MIL_INT>(Runs[r].X, RowBegin);
+            MIL_INT RunEnd = std::min<MIL_INT>(Runs[r].X + Runs[r].Count, RowEnd);
+            if(RunEnd > RunBegin)
+               Func(RunBegin, Y, RunEnd - RunBegin);
+            }
+         }
+      }
+   };
+
+//****************************************************************************
+// Build the validity index of an organized point cloud from the validity of
+// its points. The rows are indexed in parallel.
+//****************************************************************************
+template <class IsValidFunc>
+SValidityIndex BuildValidityIndex(MIL_INT SizeX, MIL_INT SizeY, IsValidFunc IsValidPoint)
+   {
+   SValidityIndex Index;
+   Index.SizeX = SizeX;
+   Index.SizeY = SizeY;
+
+   std::vector<std::vector<SValidRun>> RowRuns(SizeY);
+   ParallelForEachTask(SizeY, GetNbWorkers(), [&](MIL_INT Y, MIL_INT)
+      {
+      for(MIL_INT X = 0; X < SizeX;)
+         {
+         while(X < SizeX && !IsValidPoint(X, Y))
+            X++;
+         MIL_INT RunStart = X;
+         while(X < SizeX && IsValidPoint(X, Y))
+            X++;
+         if(X > RunStart)
+            RowRuns[Y].push_back({static_cast<MIL_INT32>(RunStart), static_cast<MIL_INT32>(X - RunStart)});
+         }
+      });
+
+   Index.RowFirstRun.resize(SizeY + 1);
+   for(MIL_INT Y = 0; Y < SizeY; Y++)
+      {
+      Index.RowFirstRun[Y] = static_cast<MIL_INT>(Index.Runs.size());
+      for(const auto& Run : RowRuns[Y])
+         {
+         Index.Runs.push_back(Run);
+         Index.NbValidPoints += Run.Count;
+         }
+      }
+   Index.RowFirstRun[SizeY] = static_cast<MIL_INT>(Index.Runs.size());
+   return Index;
+   }